@@ -54,6 +54,60 @@
 #define __STR__(x)         #x
 #define WGSTR(x)           __STR__(x)
 
+/*
+ * Counters and values that several threads may change at the same time.
+ * WGATOMICADD() gives the value from before the addition.
+ * WGATOMICCAS(p, old, new) stores new in *p if it holds old, and tells
+ * whether it did. A value stored with WGATOMICPUBLISH() is read with
+ * WGATOMICACQUIRE(), which makes whatever was written before it visible.
+ * WGATOMICEXCHANGE(p, v, old) stores the pointer v in *p and what *p held
+ * in old, which must not be v, making visible whatever was written before
+ * either pointer was stored.
+ * The WGATOMICSYNC versions of adding, reading and storing also happen in
+ * one order that all threads agree on.
+ */
+#if defined(__GNUC__)
+#define WGATOMICINC(p)     __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#define WGATOMICADD(p, n)  __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#define WGATOMICGET(p)     __atomic_load_n((p), __ATOMIC_RELAXED)
+#define WGATOMICCAS(p, old, new) \
+    __atomic_compare_exchange_n((p), &(old), (new), 0, \
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+#define WGATOMICACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define WGATOMICPUBLISH(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define WGATOMICEXCHANGE(p, v, old) \
+    ((old) = __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL))
+#define WGATOMICSYNCADD(p, n) __atomic_fetch_add((p), (n), __ATOMIC_SEQ_CST)
+#define WGATOMICSYNCGET(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define WGATOMICSYNCSET(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define WGATOMICINC(p)     _InterlockedIncrement((volatile long *)(p))
+#define WGATOMICADD(p, n)  _InterlockedExchangeAdd((volatile long *)(p), (n))
+#define WGATOMICGET(p)     (*(p))
+#define WGATOMICCAS(p, old, new) \
+    (_InterlockedCompareExchange((volatile long *)(p), (new), (old)) == (old))
+#define WGATOMICACQUIRE(p) (*(volatile long *)(p))
+#define WGATOMICPUBLISH(p, v) _InterlockedExchange((volatile long *)(p), (v))
+#define WGATOMICEXCHANGE(p, v, old) \
+    ((old) = _InterlockedExchangePointer((void *volatile *)(p), (v)))
+#define WGATOMICSYNCADD(p, n) \
+    _InterlockedExchangeAdd((volatile long *)(p), (n))
+#define WGATOMICSYNCGET(p) _InterlockedOr((volatile long *)(p), 0)
+#define WGATOMICSYNCSET(p, v) _InterlockedExchange((volatile long *)(p), (v))
+#else
+#define WGATOMICINC(p)     (++*(p))
+#define WGATOMICADD(p, n)  ((*(p) += (n)) - (n))
+#define WGATOMICGET(p)     (*(p))
+#define WGATOMICCAS(p, old, new) (*(p) == (old) ? (*(p) = (new), 1) : 0)
+#define WGATOMICACQUIRE(p) (*(p))
+#define WGATOMICPUBLISH(p, v) (*(p) = (v))
+#define WGATOMICEXCHANGE(p, v, old) ((old) = *(p), *(p) = (v), (old))
+#define WGATOMICSYNCADD(p, n) WGATOMICADD(p, n)
+#define WGATOMICSYNCGET(p) (*(p))
+#define WGATOMICSYNCSET(p, v) (*(p) = (v))
+#endif
+
 #endif
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -46,7 +46,8 @@
 #define THRESHOLDVALUE  1.03
 
 /* If more than MAXCANDIDATES matches are found, the classifier reports
-   unknown, because the input is obviously confusing. */
+   unknown, because the input is obviously confusing. The library goes by
+   TEXTCAT_MAXCANDIDATES of textcat.h, which has the same value. */
 #define MAXCANDIDATES   5
 
 /* The size of the buffer used to report the classification. */
@@ -71,7 +72,32 @@
 /* Maximum penalty for missing an n-gram in fingerprint */
 #define MAXOUTOFPLACE 400
 
-/* Size of hash table is 2^TABLEPOW. */
+/* Largest number of cells (distinct n-grams times fingerprints) for which
+   the rank matrix of the n-gram index is built. Larger sets of
+   fingerprints are compared one by one. */
+#define MAXINDEXCELLS (1<<24)
+
+/* Size in bits (a multiple of 64) of the signatures used for a lower
+   bound on scores when fingerprints are compared one by one. */
+#define SIGNATUREBITS 4096
+
+/* With TCPROP_ADAPTIVE_ORDER, the ADAPTIVEFIRST categories that won most
+   often are compared first, and a context looks at the counts again every
+   ADAPTIVEINTERVAL classifications. */
+#define ADAPTIVEFIRST 4
+#define ADAPTIVEINTERVAL 64
+
+/* Fingerprints that are compared one by one are clustered into a tree
+   in which every node has up to TREEFANOUT children, and every leaf up
+   to TREELEAFSIZE fingerprints. */
+#define TREEFANOUT 8
+#define TREELEAFSIZE 8
+
+/* Largest number of threads TCPROP_THREADS can ask for */
+#define MAXTHREADS 64
+
+/* Initial size of the n-gram hash table is 2^TABLEPOW; it grows as
+   needed. */
 #define TABLEPOW  13
 
 #define MAXSCORE  INT_MAX
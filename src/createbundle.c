@@ -0,0 +1,154 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * createbundle.c -- compile the fingerprints listed in a configuration
+ * file into one bundle file, see textcat_InitBundle().
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * USAGE
+ *
+ * createbundle [--c] conffile prefix bundlefile
+ *
+ * loads the fingerprints the way special_textcat_Init(conffile, prefix)
+ * does, and writes them to bundlefile. With --c, bundlefile becomes C
+ * source that defines the bundle as the array fpbuiltin_data, see
+ * fpbuiltin.c.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_impl.h"
+#include "textcat.h"
+
+/* words of the array per line */
+#define WORDSPERLINE 4
+
+/* writes the bundle in bundlefile to cfile as a C array */
+static int writec(const char *bundlefile, const char *cfile)
+{
+    FILE *in = fopen(bundlefile, "rb");
+    FILE *out;
+    unsigned char word[8];
+    uint64_t w;
+    size_t n = 0;
+
+    if (!in)
+    {
+        return 0;
+    }
+    out = fopen(cfile, "w");
+    if (!out)
+    {
+        fclose(in);
+        return 0;
+    }
+
+    fprintf(out, "/* Generated by createbundle, do not edit */\n\n"
+            "#ifdef __GNUC__\n"
+            "#define FPBUILTIN_ALIGN __attribute__ ((aligned (64)))\n"
+            "#else\n"
+            "#define FPBUILTIN_ALIGN\n"
+            "#endif\n\n"
+            "static const uint64_t fpbuiltin_data[] FPBUILTIN_ALIGN = {");
+
+    /*** Bundles come in whole words, in the byte order of this machine ***/
+    while (fread(word, 1, sizeof(word), in) == sizeof(word))
+    {
+        memcpy(&w, word, sizeof(w));
+        fprintf(out, "%s0x%08lx%08lxULL,", n % WORDSPERLINE ? " " : "\n    ",
+                (unsigned long)(w >> 32), (unsigned long)(w & 0xFFFFFFFFUL));
+        n++;
+    }
+    fprintf(out, "\n};\n");
+    fclose(in);
+    return (fclose(out) == 0) && n > 0;
+}
+
+int main(int argc, char **args)
+{
+    const char *name = args[0];
+    void *h;
+    int c = 0;
+    int ok;
+
+    if (argc > 1 && !strcmp(args[1], "--c"))
+    {
+        c = 1;
+        args++;
+        argc--;
+    }
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: %s [--c] conffile prefix bundlefile\n",
+                name);
+        return 1;
+    }
+
+    h = special_textcat_Init(args[1], args[2]);
+    if (!h)
+    {
+        fprintf(stderr, "Unable to load the fingerprints listed in %s\n",
+                args[1]);
+        return 1;
+    }
+    if (c)
+    {
+        char *tmp = (char *)malloc(strlen(args[3]) + 5);
+
+        ok = tmp != NULL;
+        if (ok)
+        {
+            strcpy(tmp, args[3]);
+            strcat(tmp, ".tmp");
+            ok = textcat_WriteBundle(h, tmp) && writec(tmp, args[3]);
+            remove(tmp);
+            free(tmp);
+        }
+    }
+    else
+    {
+        ok = textcat_WriteBundle(h, args[3]);
+    }
+    textcat_Done(h);
+    if (!ok)
+    {
+        fprintf(stderr, "Unable to write %s\n", args[3]);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -71,120 +71,190 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USEMMAP
+#endif
 
 #include "common_impl.h"
-#include "wg_mempool.h"
 #include "constants.h"
 
-#include "utf8misc.h"
 #include "fingerprint.h"
+#include "fingerprint_impl.h"
 
 #define TABLESIZE  (1<<TABLEPOW)
 #define TABLEMASK  ((TABLESIZE)-1)
 
-typedef struct
-{
-
-    sint2 rank;
-    char str[MAXNGRAMSIZE + 1];
-
-} ngram_t;
-
-typedef struct fp_s
-{
-
-    const char *name;
-    ngram_t *fprint;
-    uint4 size;
-    uint4 mindocsize;
-    boole utfaware;
-
-} fp_t;
-
 typedef struct entry_s
 {
-    char str[MAXNGRAMSIZE + 1];
-    unsigned int cnt;
-    struct entry_s *next;
+    ngramkey_t key;
+    uint4 cnt;
+    uint4 hash;
 } entry_t;
 
+typedef struct
+{
+    uint4 hash;                 /* hash tag of the entry */
+    uint4 entry;                /* entry index + 1, or 0 for an empty slot */
+} slot_t;
+
+/*
+ * The n-grams are counted in an open addressing hash table. The slots only
+ * hold a hash tag and an index, so probing rarely has to look at the
+ * entries themselves, which are kept in order of creation in a separate
+ * array. Both grow by doubling: the slots when the table gets half full,
+ * the entries when they run out.
+ */
 typedef struct table_s
 {
-    void *pool;
-    entry_t **table;
-    entry_t *heap;
-
-    struct table_s *next;
-
-    uint4 heapsize;
+    slot_t *slot;
+    uint4 mask;                 /* number of slots - 1 */
+    uint4 shift;                /* 32 - log2(number of slots) */
+
+    entry_t *entry;
+    uint4 nentries;
+    uint4 maxentries;
+
+    uint4 *heap;
+    uint4 heapsize;             /* number of n-grams to select */
+    uint4 maxheap;              /* room in heap, tmpkey and tmprank */
+    ngramkey_t *tmpkey;         /* scratch for sortngrams() */
+    sint2 *tmprank;
     uint4 size;
+
+    uint4 *first;               /* TABLESIZE + 1 group offsets */
+    uint4 *order;               /* entries in order of insertion into heap */
+    uint4 maxorder;
 } table_t;
 
 /* 
  * fast and furious little hash function
  *
- * (Note that we could use some kind of rolling checksum, and update it
- * during n-gram construction)
+ * The hash of an n-gram of nsym symbols and bytes c[0]..c[len-1] is
+ *
+ *   nsym * 13 * 31^len + c[0] * 31^(len-1) + ... + c[len-1]
+ *
+ * which can be updated byte by byte while an n-gram is being extended:
+ * HASHBYTE() adds a byte to the polynomial part, and keeps track of
+ * 31^len, and NGRAMHASH() combines the two.
  */
-static uint4 simplehash(const char *p, int len)
+#define HASHBYTE(poly, pow, c) \
+    ((poly) = ((poly) << 5) - (poly) + (c), (pow) = ((pow) << 5) - (pow))
+#define NGRAMHASH(poly, pow, nsym) ((uint4)(nsym) * 13 * (pow) + (poly))
+
+#define SLOTINDEX(t, hash) (((hash) * 0x9E3779B1U) >> (t)->shift)
+
+/* doubles the number of slots */
+static int growslots(table_t * t)
 {
-    uint4 h = len * 13;
-    while (*p)
+    uint4 size = (t->mask + 1) << 1;
+    slot_t *slot = (slot_t *) calloc(size, sizeof(slot_t));
+    uint4 i;
+
+    if (!slot)
     {
-        h = (h << 5) - h + *p++;
+        return 0;
     }
-    return h;
+    t->mask = size - 1;
+    t->shift--;
+
+    /*** Rehash using the tags, the entries need not be touched ***/
+    for (i = 0; i < (t->mask + 1) >> 1; i++)
+    {
+        if (t->slot[i].entry)
+        {
+            uint4 k = SLOTINDEX(t, t->slot[i].hash);
+            while (slot[k].entry)
+            {
+                k = (k + 1) & t->mask;
+            }
+            slot[k] = t->slot[i];
+        }
+    }
+
+    free(t->slot);
+    t->slot = slot;
+    return 1;
 }
 
-/* increases frequency of ngram(p,len) */
-static int increasefreq(table_t * t, char *p, int len,
-                        int issameimpl(char *, char *, int))
+/* increases frequency of the n-gram key */
+static int increasefreq(table_t * t, const ngramkey_t * key, uint4 hash)
 {
-    uint4 hash = simplehash(p, len) & TABLEMASK;
-    entry_t *entry = t->table[hash];
+    uint4 i = SLOTINDEX(t, hash);
+    entry_t *entry;
 
-    while (entry)
+    while (t->slot[i].entry)
     {
-        if (issameimpl(entry->str, p, len))
+        if (t->slot[i].hash == hash)
         {
-            /*** Found it! ***/
-            entry->cnt++;
-            return 1;
+            entry = &t->entry[t->slot[i].entry - 1];
+            if (KEYEQUAL(entry->key, *key))
+            {
+                /*** Found it! ***/
+                entry->cnt++;
+                return 1;
+            }
         }
-        else
+        i = (i + 1) & t->mask;
+    }
+
+    /*** Not found, so create ***/
+    if (t->nentries == t->maxentries)
+    {
+        uint4 maxentries = t->maxentries << 1;
+        entry_t *tmp =
+            (entry_t *) realloc(t->entry, sizeof(entry_t) * maxentries);
+        if (!tmp)
         {
-            entry = entry->next;
+            return 0;
         }
+        t->entry = tmp;
+        t->maxentries = maxentries;
     }
 
-    /*** Not found, so create ***/
-    entry = (entry_t *) (wgmempool_alloc(t->pool, sizeof(entry_t)));
-    strncpy(entry->str, p, MAXNGRAMSIZE);
-    entry->str[MAXNGRAMSIZE] = 0;
+    entry = &t->entry[t->nentries];
+    entry->key = *key;
     entry->cnt = 1;
+    entry->hash = hash;
 
-    entry->next = t->table[hash];
-    t->table[hash] = entry;
+    t->slot[i].hash = hash;
+    t->slot[i].entry = ++t->nentries;
+
+    /*** Keep the load factor below 1/2 ***/
+    if (t->nentries > (t->mask + 1) >> 1)
+    {
+        growslots(t);
+    }
 
     return 1;
 }
 
-#define GREATER(x,y) ((x).cnt > (y).cnt)
-#define LESS(x,y)    ((x).cnt < (y).cnt)
+/*
+ * The heap holds indices of table entries rather than the entries
+ * themselves, so reheaping moves 4 bytes at a time.
+ */
+#define GREATER(t,x,y) ((t)->entry[x].cnt > (t)->entry[y].cnt)
+#define LESS(t,x,y)    ((t)->entry[x].cnt < (t)->entry[y].cnt)
 
 static void siftup(table_t * t, unsigned int child)
 {
-    entry_t *heap = t->heap;
+    uint4 *heap = t->heap;
     unsigned int parent = (child - 1) >> 1;
-    entry_t tmp;
+    uint4 tmp;
 
     while (child > 0)
     {
-        if (GREATER(heap[parent], heap[child]))
+        if (GREATER(t, heap[parent], heap[child]))
         {
-            memcpy(&tmp, &heap[parent], sizeof(entry_t));
-            memcpy(&heap[parent], &heap[child], sizeof(entry_t));
-            memcpy(&heap[child], &tmp, sizeof(entry_t));
+            tmp = heap[parent];
+            heap[parent] = heap[child];
+            heap[child] = tmp;
         }
         else
             return;
@@ -196,21 +266,21 @@ static void siftup(table_t * t, unsigned int child)
 
 static void siftdown(table_t * t, unsigned int heapsize, uint4 parent)
 {
-    entry_t *heap = t->heap;
+    uint4 *heap = t->heap;
     unsigned int child = parent * 2 + 1;
-    entry_t tmp;
+    uint4 tmp;
 
     while (child < heapsize)
     {
-        if (child + 1 < heapsize && GREATER(heap[child], heap[child + 1]))
+        if (child + 1 < heapsize && GREATER(t, heap[child], heap[child + 1]))
         {
             child++;
         }
-        if (GREATER(heap[parent], heap[child]))
+        if (GREATER(t, heap[parent], heap[child]))
         {
-            memcpy(&tmp, &heap[parent], sizeof(entry_t));
-            memcpy(&heap[parent], &heap[child], sizeof(entry_t));
-            memcpy(&heap[child], &tmp, sizeof(entry_t));
+            tmp = heap[parent];
+            heap[parent] = heap[child];
+            heap[child] = tmp;
         }
         else
             return;
@@ -219,43 +289,39 @@ static void siftdown(table_t * t, unsigned int heapsize, uint4 parent)
     }
 }
 
-static int heapinsert(table_t * t, entry_t * item)
+static int heapinsert(table_t * t, uint4 item)
 {
-    entry_t *heap = t->heap;
+    uint4 *heap = t->heap;
 
     /*** Still room for an entry? ***/
     if (t->size < t->heapsize)
     {
-        memcpy(&(heap[t->size]), item, sizeof(entry_t));
+        heap[t->size] = item;
         siftup(t, t->size);
         t->size++;
         return 0;
     }
 
     /*** Worse than the worst performer? ***/
-    if (LESS(*item, heap[0]))
+    if (LESS(t, item, heap[0]))
     {
         return 0;
     }
 
     /*** Insert into heap and reheap ***/
-    memcpy(&(heap[0]), item, sizeof(entry_t));
+    heap[0] = item;
     siftdown(t, t->size, 0);
     return 0;
 }
 
-static int heapextract(table_t * t, entry_t * item)
+static int heapextract(table_t * t, uint4 * item)
 {
-    entry_t *p;
-
     if (t->size == 0)
         return 0;
 
-    p = &(t->heap[0]);
-
-    memcpy(item, p, sizeof(entry_t));
+    *item = t->heap[0];
     if (t->size > 1)
-        memcpy(&(t->heap[0]), &(t->heap[t->size - 1]), sizeof(entry_t));
+        t->heap[0] = t->heap[t->size - 1];
 
     siftdown(t, t->size, 0);
     t->size--;
@@ -264,46 +330,130 @@ static int heapextract(table_t * t, entry_t * item)
 }
 
 /*** Makes a heap of all table entries ***/
+/*
+ * The heap breaks ties between n-grams of equal frequency by the order in
+ * which they are inserted. To keep fingerprints the same as they have
+ * always been, the entries are inserted grouped by the low TABLEPOW bits of
+ * their hash, and newest first within a group, which is how the chained
+ * hash table that used to count them was traversed.
+ */
 static int table2heap(table_t * t)
 {
-    int i;
+    uint4 *first = t->first;
+    uint4 *order;
+    uint4 i;
 
-    /*** Fill result heap ***/
-    for (i = 0; i < TABLESIZE; i++)
+    if (t->maxorder < t->nentries)
     {
-        entry_t *p = t->table[i];
-        while (p)
+        free(t->order);
+        t->order = (uint4 *) malloc(sizeof(uint4) * t->maxentries);
+        t->maxorder = t->order ? t->maxentries : 0;
+        if (!t->order)
         {
-            heapinsert(t, p);
-            p = p->next;
+            return 0;
         }
     }
+    order = t->order;
+
+    /*** Counting sort on the group ***/
+    memset(first, 0, sizeof(uint4) * (TABLESIZE + 1));
+    for (i = 0; i < t->nentries; i++)
+    {
+        first[(t->entry[i].hash & TABLEMASK) + 1]++;
+    }
+    for (i = 1; i <= TABLESIZE; i++)
+    {
+        first[i] += first[i - 1];
+    }
+    for (i = t->nentries; i-- > 0;)
+    {
+        order[first[t->entry[i].hash & TABLEMASK]++] = i;
+    }
+
+    /*** Fill result heap ***/
+    for (i = 0; i < t->nentries; i++)
+    {
+        heapinsert(t, order[i]);
+    }
 
     return 1;
 }
 
-static table_t *inittable(uint4 maxngrams)
+static void tabledone(table_t * t)
+{
+    if (!t)
+        return;
+
+    free(t->slot);
+    free(t->entry);
+    free(t->heap);
+    free(t->tmpkey);
+    free(t->tmprank);
+    free(t->first);
+    free(t->order);
+    free(t);
+}
+
+static table_t *inittable(void)
 {
     table_t *result = (table_t *) calloc(1, sizeof(table_t));
-    result->table = (entry_t **) calloc(1, sizeof(entry_t *) * TABLESIZE);
-    result->pool = wgmempool_Init(10000, 10);
+    if (!result)
+        return NULL;
+
+    result->slot = (slot_t *) calloc(TABLESIZE, sizeof(slot_t));
+    result->mask = TABLEMASK;
+    result->shift = 32 - TABLEPOW;
+
+    result->entry = (entry_t *) malloc(sizeof(entry_t) * TABLESIZE);
+    result->maxentries = TABLESIZE;
 
-    result->heap = (entry_t *) malloc(sizeof(entry_t) * maxngrams);
-    result->heapsize = maxngrams;
-    result->size = 0;
+    result->first = (uint4 *) malloc(sizeof(uint4) * (TABLESIZE + 1));
 
+    if (!result->slot || !result->entry || !result->first)
+    {
+        tabledone(result);
+        return NULL;
+    }
     return result;
 }
 
-static void tabledone(table_t * t)
+/* empties t, so it can count the n-grams of a new buffer */
+static int resettable(table_t * t, uint4 maxngrams)
 {
-    if (!t)
-        return;
+    /*** Give back the slots of an unusually large buffer ***/
+    if (t->mask > TABLEMASK && t->nentries < (t->mask + 1) >> 3)
+    {
+        slot_t *slot =
+            (slot_t *) realloc(t->slot, sizeof(slot_t) * TABLESIZE);
+        if (slot)
+        {
+            t->slot = slot;
+            t->mask = TABLEMASK;
+            t->shift = 32 - TABLEPOW;
+        }
+    }
+    memset(t->slot, 0, sizeof(slot_t) * (t->mask + 1));
+    t->nentries = 0;
 
-    wgmempool_Done(t->pool);
-    free(t->table);
-    free(t->heap);
-    free(t);
+    if (t->maxheap < maxngrams)
+    {
+        free(t->heap);
+        free(t->tmpkey);
+        free(t->tmprank);
+        t->heap = (uint4 *) malloc(sizeof(uint4) * maxngrams);
+        t->tmpkey = (ngramkey_t *) malloc(sizeof(ngramkey_t) * maxngrams);
+        t->tmprank = (sint2 *) malloc(sizeof(sint2) * maxngrams);
+        if (!t->heap || !t->tmpkey || !t->tmprank)
+        {
+            t->maxheap = 0;
+            return 0;
+        }
+        t->maxheap = maxngrams;
+    }
+    t->heapsize = maxngrams;
+    t->size = 0;
+
+    return 1;
 }
 
 extern void *fp_Init(const char *name)
@@ -323,49 +473,386 @@ extern void fp_Done(void *handle)
 {
     fp_t *h = (fp_t *) handle;
 
-    if (h->name)
+    if (!h->borrowed)
     {
         free((void *)h->name);
+        free(h->key);
+        free(h->rank);
+        free(h->signature);
     }
-    if (h->fprint)
-    {
-        free(h->fprint);
-    }
+    tabledone((table_t *) h->table);
 
     free(h);
 }
 
+extern int fp_KeepBuffers(void *handle)
+{
+    fp_t *h = (fp_t *) handle;
+
+    if (!h->table)
+    {
+        h->table = inittable();
+    }
+    return h->table != NULL;
+}
+
 extern const char *fp_Name(void *handle)
 {
     fp_t *h = (fp_t *) handle;
     return h->name;
 }
 
+/**
+ * The n-grams are extracted in a single pass over the buffer. The
+ * buffer is normalized on the fly by normalize(), which feeds the
+ * resulting bytes to addbyte(). That groups them into symbols (single
+ * bytes, or utf-8 characters when the fingerprint is utf-8 aware), and
+ * keeps the most recent ones in a small ring. As soon as the ring holds
+ * enough symbols to see every n-gram starting at its oldest symbol,
+ * countngrams() counts those and the oldest symbol is dropped.
+ *
+ * The bytes of the ring are stored twice, RINGSIZE apart, so that any
+ * n-gram in it can be read as one contiguous string.
+ */
+#define RINGSIZE 32
+#define RINGMASK (RINGSIZE - 1)
+
+typedef struct
+{
+    table_t *t;
+    uint4 maxsym;               /* longest n-gram, in symbols */
+    boole utfaware;
+
+    uint4 pos;                  /* stream position of the next byte */
+    uint4 pending;              /* bytes missing from the last symbol */
+    uchar lo, hi;               /* range of the next byte of the symbol */
+    uint4 first;                /* ring index of the oldest symbol */
+    uint4 nsym;                 /* number of symbols in the ring */
+    uint4 sympos[RINGSIZE];     /* stream position of each symbol */
+    uchar symlen[RINGSIZE];     /* length in bytes of each symbol */
+    char buf[2 * RINGSIZE];
+} ngramstream_t;
+
+/*
+ * Length of the utf-8 sequence that starts with a byte. Bytes that cannot
+ * start a well-formed sequence (continuation bytes, 0xC0, 0xC1 and 0xF5 to
+ * 0xFF) make up a symbol of their own.
+ */
+static const uchar utf8length[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1
+};
+
+/*
+ * starts a symbol with byte c, and sets up which bytes may follow it:
+ * continuation bytes, further restricted after some lead bytes to rule
+ * out overlong forms, surrogates and code points above U+10FFFF
+ */
+static void utf8start(ngramstream_t * s, uchar c)
+{
+    s->pending = utf8length[c] - 1;
+    s->lo = 0x80;
+    s->hi = 0xBF;
+
+    switch (c)
+    {
+    case 0xE0:
+        s->lo = 0xA0;
+        break;
+    case 0xED:
+        s->hi = 0x9F;
+        break;
+    case 0xF0:
+        s->lo = 0x90;
+        break;
+    case 0xF4:
+        s->hi = 0x8F;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Counts all n-grams starting at the oldest symbol in the ring, given
+ * that avail symbols are known to follow it (including itself). Allow
+ * underscores only at borders.
+ *
+ * Returns 0 when the end of the buffer was reached; this mirrors the
+ * original extraction loop, which stopped as soon as an n-gram could not
+ * be extended any further.
+ */
+static int countngrams(ngramstream_t * s, uint4 avail)
+{
+    const char *p = &s->buf[s->sympos[s->first] & RINGMASK];
+    ngramkey_t key;
+    uint4 len = 0;
+    uint4 poly = 0;
+    uint4 pow = 1;
+    uint4 i;
+
+    memset(&key, 0, sizeof(key));
+
+    for (i = 1; i <= s->maxsym; i++)
+    {
+        uint4 sym = (s->first + i - 1) & RINGMASK;
+        const char *q = p + len;
+        uint4 k;
+
+        for (k = 0; k < s->symlen[sym]; k++, len++)
+        {
+            HASHBYTE(poly, pow, q[k]);
+            KEYADDBYTE(key, len, q[k]);
+        }
+
+        increasefreq(s->t, &key, NGRAMHASH(poly, pow, i));
+
+        /*** First char may be an underscore ***/
+        if (i > 1 && *q == '_')
+        {
+            return 1;
+        }
+        if (i == avail)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* appends the symbol that was completed last to the ring */
+static void addsymbol(ngramstream_t * s)
+{
+    if (++s->nsym == s->maxsym + 1)
+    {
+        countngrams(s, s->nsym);
+        s->first = (s->first + 1) & RINGMASK;
+        s->nsym--;
+    }
+}
+
+static void addbyte(ngramstream_t * s, char c)
+{
+    uchar u = (uchar) c;
+
+    s->buf[s->pos & RINGMASK] = c;
+    s->buf[(s->pos & RINGMASK) + RINGSIZE] = c;
+
+    if (s->pending)
+    {
+        if (u >= s->lo && u <= s->hi)
+        {
+            /*** Continuation of a multi-byte symbol ***/
+            s->symlen[(s->first + s->nsym) & RINGMASK]++;
+            s->lo = 0x80;
+            s->hi = 0xBF;
+            if (--s->pending == 0)
+            {
+                addsymbol(s);
+            }
+            s->pos++;
+            return;
+        }
+
+        /*** Malformed: the symbol ends short, and c starts the next ***/
+        s->pending = 0;
+        addsymbol(s);
+    }
+
+    {
+        uint4 sym = (s->first + s->nsym) & RINGMASK;
+
+        s->sympos[sym] = s->pos;
+        s->symlen[sym] = 1;
+        if (s->utfaware)
+        {
+            utf8start(s, u);
+        }
+        if (s->pending == 0)
+        {
+            addsymbol(s);
+        }
+    }
+    s->pos++;
+}
+
+/* counts the n-grams that start at the symbols still left in the ring */
+static void flush(ngramstream_t * s)
+{
+    if (s->pending)
+    {
+        /*** Buffer ended in the middle of a symbol ***/
+        s->pending = 0;
+        s->nsym++;
+    }
+
+    while (s->nsym > 0 && countngrams(s, s->nsym))
+    {
+        s->first = (s->first + 1) & RINGMASK;
+        s->nsym--;
+    }
+}
+
+/**
+ * INVALID() depends on the locale, so it is evaluated once per buffer
+ * for every byte value, rather than once per byte of the buffer.
+ *
+ * Returns whether the result is the usual set of spaces and digits of
+ * the "C" locale, which the SSE2 scanners below test for directly.
+ */
+static boole initinvalid(uchar * invalid)
+{
+    boole usual = 1;
+    int c;
+
+    for (c = 0; c < 256; c++)
+    {
+        invalid[c] = INVALID(c) ? 1 : 0;
+        if (invalid[c] != (c == ' ' || (c >= '\t' && c <= '\r')
+                           || (c >= '0' && c <= '9')))
+        {
+            usual = 0;
+        }
+    }
+    return usual;
+}
+
+#ifdef __SSE2__
+/* bit mask of the bytes in c that are usual spaces or digits */
+static int invalidmask(__m128i c)
+{
+    __m128i ws = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+    __m128i dg = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i m = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+
+    /*** Unsigned range checks: x - lo <= hi - lo ***/
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(ws,
+                                                    _mm_set1_epi8('\r' -
+                                                                  '\t')),
+                                       ws));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(dg,
+                                                    _mm_set1_epi8('9' - '0')),
+                                       dg));
+    return _mm_movemask_epi8(m);
+}
+#endif
+
+/**
+ * Returns the number of bytes at p, up to max, that are neither invalid
+ * nor zero. The first safe bytes at p may be read 16 at a time.
+ */
+static size_t wordrun(const uchar * invalid, boole usual, const char *p,
+                      size_t max, size_t safe)
+{
+    size_t n = 0;
+
+#ifdef __SSE2__
+    if (usual)
+    {
+        safe = WGMIN(safe, max);
+        while (n + 16 <= safe)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(p + n));
+            int m = invalidmask(c)
+                | _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_setzero_si128()));
+            if (m)
+            {
+                return n + __builtin_ctz(m);
+            }
+            n += 16;
+        }
+    }
+#endif
+    while (n < max && !invalid[(uchar) p[n]] && p[n] != '\0')
+    {
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Returns the number of invalid bytes at p, up to max. The first safe
+ * bytes at p may be read 16 at a time.
+ */
+static size_t spacerun(const uchar * invalid, boole usual, const char *p,
+                       size_t max, size_t safe)
+{
+    size_t n = 0;
+
+#ifdef __SSE2__
+    if (usual)
+    {
+        safe = WGMIN(safe, max);
+        while (n + 16 <= safe)
+        {
+            int m = invalidmask(_mm_loadu_si128((const __m128i *)(p + n)))
+                ^ 0xFFFF;
+            if (m)
+            {
+                return n + __builtin_ctz(m);
+            }
+            n += 16;
+        }
+    }
+#endif
+    while (n < max && invalid[(uchar) p[n]])
+    {
+        n++;
+    }
+    return n;
+}
+
 /**
  * Function that prepares buffer for n-grammification:
  * runs of invalid characters are collapsed to a single
- * underscore.
+ * underscore, and the result is fed to addbyte().
  *
- * Function is implemented as a finite state machine.
+ * Function is implemented as a finite state machine, that moves over
+ * whole runs of valid or invalid characters at a time. The buffer ends
+ * at its first zero byte, and bufsize limits the normalized result. When
+ * bounded, the buffer also ends after bufsize bytes, and nothing past
+ * them is read.
+ *
+ * Returns the size the normalized buffer would have, including its
+ * terminating zero.
  */
-static char *prepbuffer(const char *src, size_t bufsize, uint4 mindocsize)
+static size_t normalize(ngramstream_t * s, const char *src, size_t bufsize,
+                        boole bounded)
 {
     const char *p = src;
-    char *dest = (char *)malloc(bufsize + 3);
-    char *w = dest;
-    char *wlimit = dest + bufsize + 1;
-
-    if (INVALID(*p))
+    const char *plimit = src + bufsize;
+    const char *pend = bounded ? plimit : NULL;
+    size_t w = 0;
+    size_t wlimit = bufsize + 1;
+    size_t n, safe;
+    uchar invalid[256];
+    boole usual = initinvalid(invalid);
+
+    if (p == pend || *p == '\0')
     {
-        goto SPACE;
+        goto END;
     }
-    else if (*p == '\0')
+    else if (invalid[(uchar) * p])
     {
-        goto END;
+        goto SPACE;
     }
 
-    *w++ = '_';
-    if (w == wlimit)
+    addbyte(s, '_');
+    if (++w == wlimit)
     {
         goto STOP;
     }
@@ -376,17 +863,15 @@ static char *prepbuffer(const char *src, size_t bufsize, uint4 mindocsize)
   SPACE:
     /*** Inside string of invalid characters ***/
     p++;
-    if (INVALID(*p))
-    {
-        goto SPACE;
-    }
-    else if (*p == '\0')
+    safe = p < plimit ? plimit - p : 0;
+    p += spacerun(invalid, usual, p, pend ? safe : (size_t) -1, safe);
+    if (p == pend || *p == '\0')
     {
         goto END;
     }
 
-    *w++ = '_';
-    if (w == wlimit)
+    addbyte(s, '_');
+    if (++w == wlimit)
     {
         goto STOP;
     }
@@ -395,177 +880,207 @@ static char *prepbuffer(const char *src, size_t bufsize, uint4 mindocsize)
 
   WORD:
     /*** Inside string of valid characters ***/
-    *w++ = *p++;
-    if (w == wlimit)
+    safe = p < plimit ? plimit - p : 0;
+    n = wordrun(invalid, usual, p, pend ? WGMIN(wlimit - w, safe)
+                : wlimit - w, safe);
+    w += n;
+    while (n--)
     {
-        goto END;
+        addbyte(s, *p++);
     }
-    else if (INVALID(*p))
+    if (w == wlimit)
     {
-        goto SPACE;
+        goto END;
     }
-    else if (*p == '\0')
+    else if (p == pend || *p == '\0')
     {
         goto STOP;
     }
-    goto WORD;
+    goto SPACE;
 
   END:
-    *w++ = '_';
+    addbyte(s, '_');
+    w++;
 
   STOP:
-    *w++ = '\0';
-
-    /*** Docs that are too small for a fingerprint, are refused ***/
-    if (w - dest < mindocsize)
-    {
-        free(dest);
-        return NULL;
-    }
+    flush(s);
 
-    return dest;
+    return w + 1;
 }
 
 /**
 * this function extract all n-gram from past buffer and put them into the table "t"
 * [modified] by Jocelyn Merand to accept utf-8 multi-character symbols to be used in OpenOffice
+*
+* Returns the size of the normalized buffer, including its terminating
+* zero.
 */
-static void utfcreatengramtable(table_t * t, const char *buf)
+static size_t createngramtable(table_t * t, const char *buf, size_t bufsize,
+                               boole utfaware, boole bounded)
 {
-    char n[MAXNGRAMSIZE + 1];
-    const char *p = buf;
-    int i, decay;
-
-    /*** Get all n-grams where 1<=n<=MAXNGRAMSIZE. Allow underscores only at borders. ***/
-    while (1)
-    {
+    ngramstream_t s;
 
-        const char *q = p;
-        char *m = n;
+    s.t = t;
+    s.utfaware = utfaware;
+    s.maxsym = utfaware ? MAXNGRAMSYMBOL : MAXNGRAMSIZE;
+    s.pos = 0;
+    s.pending = 0;
+    s.first = 0;
+    s.nsym = 0;
 
-        /*** First char may be an underscore ***/
-        decay = utf8_charcopy(q, m);    /* [modified] previously *q++ = *m++ */
+    return normalize(&s, buf, bufsize, bounded);
+}
 
-        q += decay;             /* [modified] */
-        m += decay;             /* [modified] */
-        *m = '\0';
 
-        increasefreq(t, n, 1, utf8_issame);
+/* packs the n-gram str of len bytes into key */
+static void packkey(ngramkey_t * key, const char *str, uint4 len)
+{
+    uint4 i;
 
+    memset(key, 0, sizeof(ngramkey_t));
+    for (i = 0; i < len; i++)
+    {
+        KEYADDBYTE(*key, i, str[i]);
+    }
+}
 
-        if (*q == '\0')
-            return;
+/* unpacks key into str, which has room for MAXNGRAMSIZE + 1 bytes */
+static void unpackkey(const ngramkey_t * key, char *str)
+{
+    uint4 i;
 
-        /*** Let the compiler unroll this ***/
-        for (i = 2; i <= MAXNGRAMSYMBOL; i++)
+    for (i = 0; i < MAXNGRAMSIZE; i++)
+    {
+        str[i] = (char)(key->w[i >> 3] >> (56 - ((i & 7) << 3)));
+        if (str[i] == '\0')
         {
-            decay = utf8_charcopy(q, m);    /* [modified] like above */
-            m += decay;
-            *m = '\0';
-
-            increasefreq(t, n, i, utf8_issame);
-
-            if (*q == '_')
-                break;
-            q += decay;
-            if (*q == '\0')
-                return;
+            return;
         }
-
-        p = utf8_next_char(p);  /* [modified] */
     }
-    return;
+    str[i] = '\0';
 }
 
-/* checks if n-gram lex is a prefix of key and of length len */
-static int issame(char *lex, char *key, int len)
+#define WORDCMP(x, y) (((x) > (y)) - ((x) < (y)))
+
+/* returns -1, 0 or 1 as a is ordered before, equal to or after b */
+static int keycmp(const ngramkey_t * a, const ngramkey_t * b)
 {
-    int i;
-    for (i = 0; i < len; i++)
+    int cmp = WORDCMP(a->w[0], b->w[0]);
+
+    if (cmp == 0)
     {
-        if (key[i] != lex[i])
+        cmp = WORDCMP(a->w[1], b->w[1]);
+        if (cmp == 0)
         {
-            return 0;
+            cmp = WORDCMP(a->w[2], b->w[2]);
         }
     }
-    if (lex[i] != 0)
-    {
-        return 0;
-    }
-    return 1;
+    return cmp;
 }
 
-static void createngramtable(table_t * t, const char *buf)
+/* byte d of key, counting from the least significant byte of the last
+   word */
+#define KEYDIGIT(key, d) \
+    ((uchar) ((key).w[NGRAMKEYWORDS - 1 - ((d) >> 3)] >> (((d) & 7) << 3)))
+
+/**
+ * Sorts the n keys, and the ranks along with them, with a least
+ * significant digit first radix sort on their bytes. The histograms of
+ * all digits are made in one pass, so that digits in which all keys are
+ * the same (most of them, as most n-grams are short) cost no pass of
+ * their own. tmpkey and tmprank need room for n elements.
+ */
+static void sortngrams(ngramkey_t * key, sint2 * rank, uint4 n,
+                       ngramkey_t * tmpkey, sint2 * tmprank)
 {
-    char n[MAXNGRAMSIZE + 1];
-    const char *p = buf;
-    int i;
+    uint4 count[8 * NGRAMKEYWORDS][256];
+    ngramkey_t *srckey = key, *dstkey = tmpkey;
+    sint2 *srcrank = rank, *dstrank = tmprank;
+    uint4 d, i;
 
-    /*** Get all n-grams where 1<=n<=MAXNGRAMSIZE. Allow underscores only at borders. ***/
-    for (;; p++)
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++)
     {
+        for (d = 0; d < 8 * NGRAMKEYWORDS; d++)
+        {
+            count[d][KEYDIGIT(key[i], d)]++;
+        }
+    }
 
-        const char *q = p;
-        char *m = n;
-
-        /*** First char may be an underscore ***/
-        *m++ = *q++;
-        *m = '\0';
-
-        increasefreq(t, n, 1, issame);
+    for (d = 0; d < 8 * NGRAMKEYWORDS; d++)
+    {
+        uint4 *c = count[d];
+        uint4 sum = 0;
 
-        if (*q == '\0')
+        /*** Nothing to do if all keys have the same digit ***/
+        if (n == 0 || c[KEYDIGIT(srckey[0], d)] == n)
         {
-            return;
+            continue;
         }
 
-        /*** Let the compiler unroll this ***/
-        for (i = 2; i <= MAXNGRAMSIZE; i++)
+        for (i = 0; i < 256; i++)
         {
+            uint4 tmp = c[i];
+            c[i] = sum;
+            sum += tmp;
+        }
+        for (i = 0; i < n; i++)
+        {
+            uint4 k = c[KEYDIGIT(srckey[i], d)]++;
+            dstkey[k] = srckey[i];
+            dstrank[k] = srcrank[i];
+        }
 
-            *m++ = *q;
-            *m = '\0';
-
-            increasefreq(t, n, i, issame);
-
-            if (*q == '_')
-                break;
-            q++;
-            if (*q == '\0')
-            {
-                return;
-            }
+        /*** Swap ***/
+        {
+            ngramkey_t *tk = srckey;
+            sint2 *tr = srcrank;
+            srckey = dstkey;
+            srcrank = dstrank;
+            dstkey = tk;
+            dstrank = tr;
         }
     }
-    return;
-}
 
-
-static int mystrcmp(const char *a, const char *b)
-{
-    while (*a && *a == *b)
+    if (srckey != key)
     {
-        a++;
-        b++;
+        memcpy(key, srckey, sizeof(ngramkey_t) * n);
+        memcpy(rank, srcrank, sizeof(sint2) * n);
     }
-    return (*a - *b);
 }
 
-
-static int ngramcmp_str(const void *a, const void *b)
+/* makes the signature of h, see fp_Bound() */
+static int makesignature(fp_t * h)
 {
-    ngram_t *x = (ngram_t *) a;
-    ngram_t *y = (ngram_t *) b;
+    uint4 i;
 
-    return mystrcmp(x->str, y->str);
-}
+    if (!h->signature)
+    {
+        h->signature = (uint64_t *) malloc(sizeof(uint64_t) * SIGNATUREWORDS);
+        if (!h->signature)
+        {
+            return 0;
+        }
+    }
+    memset(h->signature, 0, sizeof(uint64_t) * SIGNATUREWORDS);
+    memset(h->scripts, 0, sizeof(h->scripts));
 
-static int ngramcmp_rank(const void *a, const void *b)
-{
-    ngram_t *x = (ngram_t *) a;
-    ngram_t *y = (ngram_t *) b;
+    for (i = 0; i < h->size; i++)
+    {
+        const ngramkey_t *key = &h->key[i];
+        uint64_t x = key->w[0] + key->w[1] * 0xC2B2AE3D27D4EB4FULL
+            + key->w[2] * 0x165667B19E3779F9ULL;
+        uint4 bit = (uint4) ((x * 0x9E3779B97F4A7C15ULL) >> 32)
+            % SIGNATUREBITS;
+        char str[MAXNGRAMSIZE + 1];
 
-    return x->rank - y->rank;
+        h->signature[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+
+        unpackkey(key, str);
+        h->scripts[script_First(str, strlen(str))]++;
+    }
+    h->hassignature = 1;
+    return 1;
 }
 
 extern int fp_SetProperty(void *handle, textcat_Property property, sint4 value)
@@ -597,72 +1112,219 @@ extern int fp_SetProperty(void *handle, textcat_Property property, sint4 value)
  * - take the most frequent n-grams
  * - sort them alphabetically, recording their relative rank
  */
-extern int fp_Create(void *handle, const char *buffer, uint4 bufsize,
-                     uint4 maxngrams)
+static int create(void *handle, const char *buffer, uint4 bufsize,
+                  uint4 maxngrams, boole bounded)
 {
     sint4 i = 0;
     table_t *t = NULL;
-    char *tmp = NULL;
 
     fp_t *h = (fp_t *) handle;
 
     if (bufsize < h->mindocsize)
         return 0;
 
-    /*** Throw out all invalid chars ***/
-    tmp = prepbuffer(buffer, bufsize, h->mindocsize);
-    /* printf("Cleaned buffer : %s\n",tmp); */
-    if (tmp == NULL)
-        return 0;
-    t = inittable(maxngrams);
+    t = h->table ? (table_t *) h->table : inittable();
+    if (!t || !resettable(t, maxngrams))
+    {
+        goto BAILOUT;
+    }
     /* printf("Table initialized\n"); */
 
     /*** Create a hash table containing n-gram counts ***/
-    if (h->utfaware)
-    {
-        utfcreatengramtable(t, tmp);
-    }
-    else
+    if (createngramtable(t, buffer, bufsize, h->utfaware, bounded)
+        < h->mindocsize)
     {
-        createngramtable(t, tmp);
+        /*** Docs that are too small for a fingerprint, are refused ***/
+        goto BAILOUT;
     }
     /* printf("Table created\n"); */
     /*** Take the top N n-grams and add them to the profile ***/
-    table2heap(t);
+    if (!table2heap(t))
+    {
+        goto BAILOUT;
+    }
     maxngrams = WGMIN(maxngrams, t->size);
 
-    h->fprint = (ngram_t *) malloc(sizeof(ngram_t) * maxngrams);
+    if (h->maxsize < maxngrams)
+    {
+        free(h->key);
+        free(h->rank);
+        h->key = (ngramkey_t *) malloc(sizeof(ngramkey_t) * maxngrams);
+        h->rank = (sint2 *) malloc(sizeof(sint2) * maxngrams);
+        h->maxsize = maxngrams;
+        if (!h->key || !h->rank)
+        {
+            h->maxsize = 0;
+            h->size = 0;
+            goto BAILOUT;
+        }
+    }
     h->size = maxngrams;
 
     /*** Pull n-grams out of heap (backwards) ***/
     for (i = maxngrams - 1; i >= 0; i--)
     {
-        entry_t tmp2;
+        uint4 tmp2 = 0;
 
         heapextract(t, &tmp2);
 
-        /*** the string and its rank is all we need ***/
-        strcpy(h->fprint[i].str, tmp2.str);
-        h->fprint[i].rank = i;
+        /*** the n-gram and its rank is all we need ***/
+        h->key[i] = t->entry[tmp2].key;
+        h->rank[i] = i;
     }
 
-    tabledone(t);
-    free(tmp);
-
     /*** Sort n-grams alphabetically, for easy comparison ***/
-    qsort(h->fprint, h->size, sizeof(ngram_t), ngramcmp_str);
+    sortngrams(h->key, h->rank, h->size, t->tmpkey, t->tmprank);
+    h->hassignature = 0;
+
+    if (t != h->table)
+    {
+        tabledone(t);
+    }
     return 1;
+
+  BAILOUT:
+    if (t != h->table)
+    {
+        tabledone(t);
+    }
+    return 0;
+}
+
+extern int fp_Create(void *handle, const char *buffer, uint4 bufsize,
+                     uint4 maxngrams)
+{
+    return create(handle, buffer, bufsize, maxngrams, 0);
+}
+
+extern int fp_CreateSpan(void *handle, const char *buffer, uint4 bufsize,
+                         uint4 maxngrams)
+{
+    return create(handle, buffer, bufsize, maxngrams, 1);
+}
+
+/*
+ * Takes up to maxngrams n-grams from the LM file in buf, the first word of
+ * every line, as the old line reader did: a line ends at a carriage return
+ * too, and a word that reaches the end of the line loses its trailing
+ * space.
+ */
+static uint4 parsengrams(fp_t * h, const char *p, const char *end,
+                         uint4 maxngrams)
+{
+    uint4 cnt = 0;
+
+    while (cnt < maxngrams && p < end)
+    {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        const char *q;
+
+        if (!eol)
+        {
+            eol = end;
+        }
+        while (p < eol && *p != '\r' && isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        for (q = p; q < eol && *q != ' ' && *q != '\t' && *q != '\r'
+             && *q != '\0'; q++)
+        {
+        }
+        if (q == eol || *q == '\r' || *q == '\0')
+        {
+            while (q > p && isspace((unsigned char)q[-1]))
+            {
+                q--;
+            }
+        }
+
+        if (q - p <= MAXNGRAMSIZE)
+        {
+            packkey(&h->key[cnt], p, q - p);
+            h->rank[cnt] = cnt;
+            cnt++;
+        }
+        p = eol + 1;
+    }
+    return cnt;
+}
+
+/* reads the whole file, where it cannot be mapped */
+static char *readfile(const char *fname, size_t *size)
+{
+    FILE *fp = fopen(fname, "rb");
+    char *data = NULL;
+    size_t used = 0;
+    size_t avail = 0;
+
+    if (!fp)
+    {
+        return NULL;
+    }
+    for (;;)
+    {
+        if (used == avail)
+        {
+            char *tmp;
+
+            avail = avail ? avail * 2 : 8192;
+            tmp = (char *)realloc(data, avail);
+            if (!tmp)
+            {
+                free(data);
+                fclose(fp);
+                return NULL;
+            }
+            data = tmp;
+        }
+        used += fread(data + used, 1, avail - used, fp);
+        if (used < avail)
+        {
+            break;
+        }
+    }
+    fclose(fp);
+    *size = used;
+    return data;
 }
 
 extern int fp_Read(void *handle, const char *fname, int maxngrams)
 {
     fp_t *h = (fp_t *) handle;
-    FILE *fp;
-    char line[1024];
-    int cnt = 0;
+    const char *data = NULL;
+    size_t size = 0;
+    boole mapped = 0;
+    boole ok = 1;
 
-    fp = fopen(fname, "r");
-    if (!fp)
+#ifdef USEMMAP
+    {
+        int fd = open(fname, O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+        {
+#ifdef VERBOSE
+            fprintf(stderr, "Failed to open fingerprint file '%s'\n",
+                    fname);
+#endif
+            return 0;
+        }
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        {
+            void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (p != MAP_FAILED)
+            {
+                data = (const char *)p;
+                size = st.st_size;
+                mapped = 1;
+            }
+        }
+        close(fd);
+    }
+#endif
+    if (!mapped && (data = readfile(fname, &size)) == NULL)
     {
 #ifdef VERBOSE
         fprintf(stderr, "Failed to open fingerprint file '%s'\n", fname);
@@ -670,38 +1332,53 @@ extern int fp_Read(void *handle, const char *fname, int maxngrams)
         return 0;
     }
 
-    h->fprint = (ngram_t *) malloc(maxngrams * sizeof(ngram_t));
-
-    while (cnt < maxngrams && wg_getline(line, 1024, fp))
+    h->key = (ngramkey_t *) malloc(maxngrams * sizeof(ngramkey_t));
+    h->rank = (sint2 *) malloc(maxngrams * sizeof(sint2));
+    h->maxsize = maxngrams;
+    if (h->key && h->rank)
+    {
+        h->size = parsengrams(h, data, data + size, maxngrams);
+    }
+    else
     {
+        ok = 0;
+    }
 
-        char *p;
+#ifdef USEMMAP
+    if (mapped)
+    {
+        munmap((void *)data, size);
+    }
+    else
+#endif
+    {
+        free((void *)data);
+    }
+    if (!ok)
+    {
+        return 0;
+    }
 
-        wg_trim(line, line);
+    /*** Sort n-grams, for easy comparison later on ***/
+    {
+        ngramkey_t *tmpkey =
+            (ngramkey_t *) malloc(sizeof(ngramkey_t) * h->size);
+        sint2 *tmprank = (sint2 *) malloc(sizeof(sint2) * h->size);
 
-        p = strpbrk(line, " \t");
-        if (p)
+        if (tmpkey && tmprank)
         {
-            *p = '\0';
+            sortngrams(h->key, h->rank, h->size, tmpkey, tmprank);
         }
-
-        if (strlen(line) > MAXNGRAMSIZE)
+        free(tmpkey);
+        free(tmprank);
+        if (!tmpkey || !tmprank)
         {
-            continue;
+            return 0;
         }
-
-        strcpy(h->fprint[cnt].str, line);
-        h->fprint[cnt].rank = cnt;
-
-        cnt++;
     }
 
-    h->size = cnt;
-
-    /*** Sort n-grams, for easy comparison later on ***/
-    qsort(h->fprint, h->size, sizeof(ngram_t), ngramcmp_str);
-
-    fclose(fp);
+    /*** Now, as fingerprints that are read are usually shared ***/
+    makesignature(h);
 
     return 1;
 }
@@ -710,18 +1387,24 @@ extern void fp_Print(void *handle, FILE * fp)
 {
     uint4 i;
     fp_t *h = (fp_t *) handle;
-    ngram_t *tmp = (ngram_t *) malloc(sizeof(ngram_t) * h->size);
+    const ngramkey_t **byrank =
+        (const ngramkey_t **)calloc(h->size + 1, sizeof(ngramkey_t *));
 
-    /*** Make a temporary and sort it on rank ***/
-    memcpy(tmp, h->fprint, h->size * sizeof(ngram_t));
-    qsort(tmp, h->size, sizeof(ngram_t), ngramcmp_rank);
+    /*** Ranks run from 0 to size - 1, so put the keys in rank order ***/
+    for (i = 0; i < h->size; i++)
+    {
+        byrank[h->rank[i]] = &h->key[i];
+    }
 
     for (i = 0; i < h->size; i++)
     {
-        /* fprintf( fp, "%s\t%i\n", tmp[i].str, tmp[i].rank ); */
-        fprintf(fp, "%s\n", tmp[i].str);
+        char str[MAXNGRAMSIZE + 1];
+
+        unpackkey(byrank[i], str);
+        /* fprintf( fp, "%s\t%i\n", str, i ); */
+        fprintf(fp, "%s\n", str);
     }
-    free(tmp);
+    free(byrank);
 }
 
 
@@ -734,43 +1417,77 @@ extern sint4 fp_Compare(void *cat, void *unknown, int cutoff)
     uint4 j = 0;
     sint4 sum = 0;
 
-    /*** Compare the profiles in mergesort fashion ***/
+    /**
+     * Compare the profiles in mergesort fashion. The steps are written
+     * without branches on the outcome of the comparison, which is
+     * impossible to predict: an n-gram of the unknown that is in the
+     * category adds its rank difference, one that is not adds
+     * MAXOUTOFPLACE, and one of the category that is not in the unknown
+     * adds nothing.
+     */
     while (i < c->size && j < u->size)
     {
+        int cmp = keycmp(&c->key[i], &u->key[j]);
+        sint4 diff = abs(c->rank[i] - u->rank[j]);
+
+        sum += cmp == 0 ? diff : cmp > 0 ? MAXOUTOFPLACE : 0;
+        if (sum > cutoff)
+            return MAXSCORE;
+        i += cmp <= 0;
+        j += cmp >= 0;
+    }
 
-        int cmp = mystrcmp(c->fprint[i].str, u->fprint[j].str);
+    /*** Process tail of unknown, if any ***/
+    sum += (u->size - j) * MAXOUTOFPLACE;
+    if (sum > cutoff)
+        return MAXSCORE;
 
-        if (cmp < 0)
-        {
-            i++;
-        }
-        else if (cmp == 0)
-        {
-            sum += abs(c->fprint[i].rank - u->fprint[j].rank);
-            if (sum > cutoff)
-                return MAXSCORE;
-            i++;
-            j++;
-        }
-        else
+    return sum;
+}
+
+extern int fp_Signature(void *handle)
+{
+    fp_t *h = (fp_t *) handle;
+
+    return h->hassignature || makesignature(h);
+}
+
+extern sint4 fp_SignatureBound(const uint64_t * signature,
+                               const uint4 * scripts, void *unknown)
+{
+    fp_t *u = (fp_t *) unknown;
+    uint4 missing = 0, inscript = 0;
+    uint4 i;
+
+    if (!fp_Signature(u))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < SIGNATUREWORDS; i++)
+    {
+        missing += POPCOUNT64(u->signature[i] & ~signature[i]);
+    }
+    for (i = 0; i < NSCRIPTS; i++)
+    {
+        if (u->scripts[i] > scripts[i])
         {
-            sum += MAXOUTOFPLACE;
-            if (sum > cutoff)
-                return MAXSCORE;
-            j++;
+            inscript += u->scripts[i] - scripts[i];
         }
     }
+    return (sint4) WGMAX(missing, inscript) * MAXOUTOFPLACE;
+}
 
-    /*** Process tail of unknown, if any ***/
-    while (j < u->size)
+extern sint4 fp_Bound(void *cat, void *unknown)
+{
+    fp_t *c = (fp_t *) cat;
+
+    /*** cat is only read, as it may be in use on other threads ***/
+    if (!c->hassignature)
     {
-        sum += MAXOUTOFPLACE;
-        if (sum > cutoff)
-            return MAXSCORE;
-        j++;
+        return 0;
     }
-
-    return sum;
+    return fp_SignatureBound(c->signature, c->scripts, unknown);
 }
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,162 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _FINGERPRINT_IMPL_H_
+#define _FINGERPRINT_IMPL_H_
+/**
+ * fingerprint_impl.h -- the in-memory layout of a fingerprint, shared by
+ * the modules that need to look inside one.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+#include "constants.h"
+#include "script.h"
+
+/*
+ * An n-gram is packed into a fixed number of 64 bit words: its bytes in
+ * big-endian order, padded with zeros. N-grams never contain a zero byte,
+ * so comparing keys word by word orders them as strings of unsigned bytes,
+ * and equality is a handful of integer compares.
+ */
+#define NGRAMKEYWORDS 3
+
+#if MAXNGRAMSIZE > 8 * NGRAMKEYWORDS
+#error "MAXNGRAMSIZE does not fit in an n-gram key"
+#endif
+
+typedef struct
+{
+    uint64_t w[NGRAMKEYWORDS];
+} ngramkey_t;
+
+#define KEYEQUAL(a, b) \
+    ((a).w[0] == (b).w[0] && (a).w[1] == (b).w[1] && (a).w[2] == (b).w[2])
+
+/* adds byte c at offset len of key */
+#define KEYADDBYTE(key, len, c) \
+    ((key).w[(len) >> 3] |= \
+     (uint64_t) (uchar) (c) << (56 - (((len) & 7) << 3)))
+
+/* number of 64 bit words in a signature, see fp_Bound() */
+#define SIGNATUREWORDS (SIGNATUREBITS / 64)
+
+#if defined(__GNUC__)
+#define POPCOUNT64(x) __builtin_popcountll(x)
+#else
+static uint4 popcount64(uint64_t x)
+{
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (uint4) ((x * 0x0101010101010101ULL) >> 56);
+}
+#define POPCOUNT64(x) popcount64(x)
+#endif
+
+/*
+ * The n-grams of a fingerprint are sorted on key, with the rank of
+ * key[i] in rank[i].
+ */
+typedef struct fp_s
+{
+
+    const char *name;
+    ngramkey_t *key;
+    sint2 *rank;
+    uint4 size;
+    uint4 maxsize;              /* number of n-grams key has room for */
+    uint4 mindocsize;
+    boole utfaware;
+    void *table;                /* kept by fp_KeepBuffers() */
+    uint64_t *signature;        /* see fp_Bound() */
+    uint4 scripts[NSCRIPTS];    /* n-grams by script of their first letter */
+    boole hassignature;
+    boole borrowed;             /* name, key, rank and signature are not ours */
+
+} fp_t;
+
+/**
+ * fp_CreateSpan() - Same as fp_Create(), except that buffer need not have
+ * a zero byte: it ends after bufsize bytes at the latest, and nothing
+ * past them is read.
+ *
+ * Returns: 1 on success, 0 on error.
+ */
+extern int fp_CreateSpan(void *handle, const char *buffer, uint4 bufsize,
+                         uint4 maxngrams);
+
+/**
+ * fp_KeepBuffers() - Make fp_Create() keep the memory it works with for
+ * the next call on handle, rather than allocating and freeing it every
+ * time. Meant for a handle that is used to fingerprint many buffers.
+ *
+ * Returns: 1 on success, 0 on error.
+ */
+extern int fp_KeepBuffers(void *handle);
+
+/**
+ * fp_Bound() - A lower bound on fp_Compare(cat, unknown, cutoff). Every
+ * fingerprint has a signature: a bitmap of SIGNATUREBITS bits, with the
+ * bit of each of its n-grams set. Each bit of unknown that cat lacks
+ * stands for at least one n-gram of unknown that cat does not have, which
+ * fp_Compare() charges MAXOUTOFPLACE. That takes a few dozen word
+ * operations instead of a merge of the fingerprints.
+ *
+ * Along with the signature goes the number of n-grams whose first letter
+ * is of each script. When unknown has more n-grams of a script than cat,
+ * the difference is missing from cat too, which makes the bound close to
+ * the actual score when cat is in another script than unknown.
+ *
+ * The signature of a fingerprint read by fp_Read() is made right away;
+ * others get theirs from fp_Signature(). Until cat has one, the bound is
+ * 0, so that fp_Bound() never writes to cat, which other threads may be
+ * comparing with at the same time.
+ */
+extern sint4 fp_Bound(void *cat, void *unknown);
+
+/**
+ * fp_Signature() - Make the signature of handle, if it has none yet.
+ *
+ * Returns: 1 on success, 0 on error.
+ */
+extern int fp_Signature(void *handle);
+
+/**
+ * fp_SignatureBound() - Same as fp_Bound() for a category with the given
+ * signature and n-grams per script. For the union of the signatures and
+ * the largest counts of a set of fingerprints, this bounds the score of
+ * each of them.
+ */
+extern sint4 fp_SignatureBound(const uint64_t * signature,
+                               const uint4 * scripts, void *unknown);
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
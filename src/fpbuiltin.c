@@ -0,0 +1,68 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * fpbuiltin.c -- the stock fingerprints, compiled into the library.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * With ./configure --enable-builtin-models, the build runs createbundle
+ * --c on langclass/fpdb.conf and langclass/LM, which writes the bundle as
+ * a constant array to fpbuiltin_data.h. The array ends up in read-only
+ * data, which every process that uses the library shares, and
+ * textcat_InitBuiltin() uses it as it is, without any file access.
+ *
+ * This file is apart from the rest of the library, so that createbundle
+ * can be linked without it.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "common_impl.h"
+#include "textcat.h"
+
+#ifdef ENABLE_BUILTIN_MODELS
+#include "fpbuiltin_data.h"
+#endif
+
+extern void *textcat_InitBuiltin(void)
+{
+#ifdef ENABLE_BUILTIN_MODELS
+    /*** Compiled in, so nothing can have damaged it since ***/
+    return textcat_InitBundleMemory(fpbuiltin_data, sizeof(fpbuiltin_data),
+                                    TCBUNDLE_TRUSTED);
+#else
+    return NULL;
+#endif
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,739 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * fpbundle.c -- a set of fingerprints compiled into one file.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * Loading the fingerprints named in a configuration file means opening
+ * and parsing every one of them, sorting their n-grams and building the
+ * n-gram index. A bundle holds the outcome of all that: the sorted n-gram
+ * arrays, signatures and script counts of the fingerprints, and the index
+ * over them if there was one, each array aligned to BUNDLEALIGN bytes. All
+ * references within the file are offsets from its start, so the file is
+ * mapped read-only as it is, at any address, and processes that map the
+ * same file or shared memory object share its pages. Opening a bundle
+ * reads and copies nothing; the fingerprints and index only point into
+ * the mapping.
+ *
+ * The layout is that of the machine that wrote the bundle. The header
+ * records the format version, byte order and sizes it was written with,
+ * and a checksum over the rest of the file, and fpbundle_Open() turns
+ * away bundles that differ in any of them. The checksum catches damaged
+ * files, not forged ones. Whether or not it is checked, every offset,
+ * size and rank is, and so is the index (see fpindex_Check()), so that
+ * even a forged bundle cannot make the library read outside it or loop.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USEMMAP
+#endif
+
+#include "common_impl.h"
+#include "constants.h"
+#include "fingerprint.h"
+#include "fingerprint_impl.h"
+#include "fpindex.h"
+#include "fpbundle.h"
+#include "textcat.h"
+
+#define BUNDLEMAGIC "TCBUNDLE"
+#define BUNDLEVERSION 2
+#define BUNDLEBYTEORDER 0x01020304
+#define BUNDLEALIGN 64
+
+/* rounds x up to a multiple of BUNDLEALIGN */
+#define ALIGNUP(x) (((x) + BUNDLEALIGN - 1) & ~(uint64_t) (BUNDLEALIGN - 1))
+
+#define CHECKSUMPRIME 0x100000001B3ULL
+
+/*
+ * All offsets are from the start of the file.
+ */
+typedef struct
+{
+    char magic[8];              /* BUNDLEMAGIC */
+    uint4 version;              /* BUNDLEVERSION */
+    uint4 byteorder;            /* BUNDLEBYTEORDER as the writer had it */
+    uint4 keysize;              /* sizeof(ngramkey_t) */
+    uint4 signaturebits;        /* SIGNATUREBITS */
+    uint4 nscripts;             /* NSCRIPTS */
+    uint4 count;                /* number of fingerprints */
+    uint64_t filesize;
+    uint64_t checksum;          /* of everything after the header */
+    uint64_t entries;           /* count entry_t */
+    uint64_t index;             /* an index_t, or 0 */
+} header_t;
+
+typedef struct
+{
+    uint64_t name;
+    uint64_t key;
+    uint64_t rank;
+    uint64_t signature;
+    uint4 size;
+    uint4 scripts[NSCRIPTS];
+} entry_t;
+
+typedef struct
+{
+    uint4 size;
+    uint4 stride;
+    uint4 nngrams;
+    uint4 mask;
+    uint64_t slot;
+    uint64_t hash;
+    uint64_t key;
+    uint64_t rank;
+} index_t;
+
+typedef struct
+{
+    const char *data;
+    uint64_t size;              /* of the bundle, from its header */
+    uint64_t mapsize;           /* of the mapping, which may be larger */
+    boole mapped;               /* by mmap(), rather than read */
+    boole borrowed;             /* given by the caller, see fpbundle_Use() */
+} bundle_t;
+
+/*
+ * FNV-1a over 64 bit words, in four lanes so that the multiplications do
+ * not wait for each other.
+ */
+static uint64_t checksum(const uint64_t * w, uint64_t n)
+{
+    uint64_t h0 = 0xCBF29CE484222325ULL, h1 = h0 + 1, h2 = h0 + 2,
+        h3 = h0 + 3;
+    uint64_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        h0 = (h0 ^ w[i]) * CHECKSUMPRIME;
+        h1 = (h1 ^ w[i + 1]) * CHECKSUMPRIME;
+        h2 = (h2 ^ w[i + 2]) * CHECKSUMPRIME;
+        h3 = (h3 ^ w[i + 3]) * CHECKSUMPRIME;
+    }
+    for (; i < n; i++)
+    {
+        h0 = (h0 ^ w[i]) * CHECKSUMPRIME;
+    }
+    return (((h0 * CHECKSUMPRIME) ^ h1) * CHECKSUMPRIME ^ h2)
+        * CHECKSUMPRIME ^ h3;
+}
+
+/* lays out the bundle in memory; the caller frees it */
+static char *makeimage(void **fprint, uint4 size, void *index,
+                       uint64_t * filesize)
+{
+    header_t header;
+    entry_t *entry;
+    index_t ix;
+    fpindex_arrays_t arrays;
+    uint64_t total;
+    char *image;
+    uint4 i;
+
+    entry = (entry_t *) calloc(size + 1, sizeof(entry_t));
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    /*** Lay out the file ***/
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLEMAGIC, sizeof(header.magic));
+    header.version = BUNDLEVERSION;
+    header.byteorder = BUNDLEBYTEORDER;
+    header.keysize = sizeof(ngramkey_t);
+    header.signaturebits = SIGNATUREBITS;
+    header.nscripts = NSCRIPTS;
+    header.count = size;
+    header.entries = ALIGNUP(sizeof(header_t));
+    total = ALIGNUP(header.entries + sizeof(entry_t) * size);
+
+    for (i = 0; i < size; i++)
+    {
+        fp_t *h = (fp_t *) fprint[i];
+
+        if (!fp_Signature(h))
+        {
+            free(entry);
+            return NULL;
+        }
+        entry[i].size = h->size;
+        memcpy(entry[i].scripts, h->scripts, sizeof(entry[i].scripts));
+        entry[i].name = total;
+        total = ALIGNUP(total + strlen(h->name ? h->name : "") + 1);
+        entry[i].key = total;
+        total = ALIGNUP(total + sizeof(ngramkey_t) * h->size);
+        entry[i].rank = total;
+        total = ALIGNUP(total + sizeof(sint2) * h->size);
+        entry[i].signature = total;
+        total = ALIGNUP(total + sizeof(uint64_t) * SIGNATUREWORDS);
+    }
+
+    if (index)
+    {
+        fpindex_Arrays(index, &arrays);
+        ix.size = arrays.size;
+        ix.stride = arrays.stride;
+        ix.nngrams = arrays.nngrams;
+        ix.mask = arrays.mask;
+        header.index = total;
+        total = ALIGNUP(total + sizeof(index_t));
+        ix.slot = total;
+        total = ALIGNUP(total + sizeof(uint4) * ((uint64_t) ix.mask + 1));
+        ix.hash = total;
+        total = ALIGNUP(total + sizeof(uint4) * ix.nngrams);
+        ix.key = total;
+        total = ALIGNUP(total + sizeof(ngramkey_t) * ix.nngrams);
+        ix.rank = total;
+        total = ALIGNUP(total + sizeof(sint2) * ix.nngrams * ix.stride);
+    }
+    header.filesize = total;
+
+    /*** Fill it in ***/
+    image = (char *)calloc(1, total);
+    if (!image)
+    {
+        free(entry);
+        return NULL;
+    }
+    for (i = 0; i < size; i++)
+    {
+        fp_t *h = (fp_t *) fprint[i];
+
+        strcpy(image + entry[i].name, h->name ? h->name : "");
+        memcpy(image + entry[i].key, h->key, sizeof(ngramkey_t) * h->size);
+        memcpy(image + entry[i].rank, h->rank, sizeof(sint2) * h->size);
+        memcpy(image + entry[i].signature, h->signature,
+               sizeof(uint64_t) * SIGNATUREWORDS);
+    }
+    memcpy(image + header.entries, entry, sizeof(entry_t) * size);
+    if (index)
+    {
+        memcpy(image + header.index, &ix, sizeof(ix));
+        memcpy(image + ix.slot, arrays.slot,
+               sizeof(uint4) * ((uint64_t) ix.mask + 1));
+        memcpy(image + ix.hash, arrays.hash, sizeof(uint4) * ix.nngrams);
+        memcpy(image + ix.key, arrays.key, sizeof(ngramkey_t) * ix.nngrams);
+        memcpy(image + ix.rank, arrays.rank,
+               sizeof(sint2) * ix.nngrams * ix.stride);
+    }
+    header.checksum = checksum((const uint64_t *)(image + sizeof(header_t)),
+                               (total - sizeof(header_t)) / 8);
+    memcpy(image, &header, sizeof(header));
+    free(entry);
+
+    *filesize = total;
+    return image;
+}
+
+extern int fpbundle_Write(const char *fname, void **fprint, uint4 size,
+                          void *index)
+{
+    uint64_t total;
+    char *image = makeimage(fprint, size, index, &total);
+    FILE *fp;
+    int ok;
+
+    if (!image)
+    {
+        return 0;
+    }
+    fp = fopen(fname, "wb");
+    if (!fp)
+    {
+#ifdef VERBOSE
+        fprintf(stderr, "Failed to open bundle file '%s'\n", fname);
+#endif
+        free(image);
+        return 0;
+    }
+    ok = fwrite(image, 1, total, fp) == total;
+    ok = (fclose(fp) == 0) && ok;
+    free(image);
+    return ok;
+}
+
+extern int fpbundle_WriteFd(int fd, void **fprint, uint4 size, void *index)
+{
+#ifdef USEMMAP
+    uint64_t total;
+    char *image = makeimage(fprint, size, index, &total);
+    struct stat st;
+    uint64_t length;
+    void *p;
+
+    if (!image)
+    {
+        return 0;
+    }
+
+    /*** Huge pages only come in whole ***/
+    length = total;
+    if (fstat(fd, &st) == 0 && st.st_blksize > 0)
+    {
+        length = (total + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+    }
+    if (ftruncate(fd, length) != 0)
+    {
+        free(image);
+        return 0;
+    }
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        free(image);
+        return 0;
+    }
+    memcpy(p, image, total);
+    munmap(p, length);
+    free(image);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* whether the length bytes at offset lie within the file */
+static boole inside(const bundle_t * b, uint64_t offset, uint64_t length)
+{
+    return offset <= b->size && length <= b->size - offset;
+}
+
+/* fills in arrays with the index ix of b */
+static void indexarrays(const bundle_t * b, const index_t * ix,
+                        fpindex_arrays_t * arrays)
+{
+    arrays->size = ix->size;
+    arrays->stride = ix->stride;
+    arrays->nngrams = ix->nngrams;
+    arrays->mask = ix->mask;
+    arrays->slot = (const uint4 *)(b->data + ix->slot);
+    arrays->hash = (const uint4 *)(b->data + ix->hash);
+    arrays->key = b->data + ix->key;
+    arrays->rank = (const sint2 *)(b->data + ix->rank);
+}
+
+/* whether the index ix of b fits the fingerprints in entry */
+static boole checkindex(const bundle_t * b, const index_t * ix,
+                        const entry_t * entry)
+{
+    fpindex_arrays_t arrays;
+    uint4 *sizes = (uint4 *) malloc(sizeof(uint4) * (ix->size + 1));
+    boole ok;
+    uint4 i;
+
+    if (!sizes)
+    {
+        return 0;
+    }
+    for (i = 0; i < ix->size; i++)
+    {
+        sizes[i] = entry[i].size;
+    }
+    indexarrays(b, ix, &arrays);
+    ok = fpindex_Check(&arrays, sizes);
+    free(sizes);
+    return ok;
+}
+
+/* whether the size ranks at rank are 0 to size - 1 */
+static boole checkranks(const sint2 * rank, uint4 size)
+{
+    uint4 i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (rank[i] < 0 || (uint4) rank[i] >= size)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Checks that b holds a bundle of this version and machine, and that
+ * nothing in it points outside it or could make the fingerprints read
+ * out of bounds. Only the checksum is left out for TCBUNDLE_TRUSTED: it
+ * finds damage, whereas the rest keeps a bad bundle from doing harm.
+ */
+static boole checkbundle(bundle_t * b, int flags)
+{
+    const header_t *header = (const header_t *)b->data;
+    const entry_t *entry;
+    uint4 i;
+
+    if (b->mapsize < sizeof(header_t)
+        || memcmp(header->magic, BUNDLEMAGIC, sizeof(header->magic)) != 0
+        || header->version != BUNDLEVERSION
+        || header->byteorder != BUNDLEBYTEORDER
+        || header->keysize != sizeof(ngramkey_t)
+        || header->signaturebits != SIGNATUREBITS
+        || header->nscripts != NSCRIPTS
+        || header->filesize > b->mapsize
+        || header->filesize % BUNDLEALIGN != 0)
+    {
+        return 0;
+    }
+    b->size = header->filesize;
+
+    if (header->entries % BUNDLEALIGN != 0
+        || !inside(b, header->entries,
+                   sizeof(entry_t) * (uint64_t) header->count))
+    {
+        return 0;
+    }
+
+    entry = (const entry_t *)(b->data + header->entries);
+    for (i = 0; i < header->count; i++)
+    {
+        if (entry[i].size > MAXNGRAMS
+            || entry[i].key % BUNDLEALIGN != 0
+            || entry[i].rank % BUNDLEALIGN != 0
+            || entry[i].signature % BUNDLEALIGN != 0
+            || !inside(b, entry[i].name, 1)
+            || !memchr(b->data + entry[i].name, '\0',
+                       b->size - entry[i].name)
+            || !inside(b, entry[i].key,
+                       sizeof(ngramkey_t) * (uint64_t) entry[i].size)
+            || !inside(b, entry[i].rank,
+                       sizeof(sint2) * (uint64_t) entry[i].size)
+            || !inside(b, entry[i].signature,
+                       sizeof(uint64_t) * SIGNATUREWORDS)
+            || !checkranks((const sint2 *)(b->data + entry[i].rank),
+                           entry[i].size))
+        {
+            return 0;
+        }
+    }
+
+    if (header->index)
+    {
+        const index_t *ix = (const index_t *)(b->data + header->index);
+
+        if (header->index % BUNDLEALIGN != 0
+            || !inside(b, header->index, sizeof(index_t))
+            || ix->slot % BUNDLEALIGN != 0 || ix->hash % BUNDLEALIGN != 0
+            || ix->key % BUNDLEALIGN != 0 || ix->rank % BUNDLEALIGN != 0
+            || ix->size != header->count
+            || (ix->mask & ((uint64_t) ix->mask + 1)) != 0
+            || !inside(b, ix->slot, sizeof(uint4) * ((uint64_t) ix->mask + 1))
+            || !inside(b, ix->hash, sizeof(uint4) * (uint64_t) ix->nngrams)
+            || !inside(b, ix->key, sizeof(ngramkey_t) * (uint64_t) ix->nngrams)
+            || !inside(b, ix->rank,
+                       sizeof(sint2) * (uint64_t) ix->nngrams * ix->stride)
+            || !checkindex(b, ix, entry))
+        {
+            return 0;
+        }
+    }
+
+    if (flags & TCBUNDLE_TRUSTED)
+    {
+        return 1;
+    }
+    return header->checksum ==
+        checksum((const uint64_t *)(b->data + sizeof(header_t)),
+                 (b->size - sizeof(header_t)) / 8);
+}
+
+/* reads the whole file, where it cannot be mapped */
+static boole readbundle(bundle_t * b, const char *fname)
+{
+    FILE *fp = fopen(fname, "rb");
+    char *data;
+    long size;
+
+    if (!fp)
+    {
+        return 0;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+    data = (char *)malloc(size + 1);
+    if (!data || fread(data, 1, size, fp) != (size_t) size)
+    {
+        free(data);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+    b->data = data;
+    b->mapsize = size;
+    b->mapped = 0;
+    return 1;
+}
+
+#ifdef USEMMAP
+/* maps fd, and applies the hints that flags asks for */
+static boole mapbundle(bundle_t * b, int fd, int flags)
+{
+    struct stat st;
+    void *p;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(header_t))
+    {
+        return 0;
+    }
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        return 0;
+    }
+    b->data = (const char *)p;
+    b->mapsize = st.st_size;
+    b->mapped = 1;
+
+    /*** Hints only: whatever the system does not grant, it does not ***/
+#ifdef MADV_HUGEPAGE
+    if (flags & TCBUNDLE_HUGEPAGES)
+    {
+        madvise(p, st.st_size, MADV_HUGEPAGE);
+    }
+#endif
+    if (flags & TCBUNDLE_WILLNEED)
+    {
+        madvise(p, st.st_size, MADV_WILLNEED);
+    }
+    if (flags & TCBUNDLE_LOCK)
+    {
+        mlock(p, st.st_size);
+    }
+    return 1;
+}
+#endif
+
+/* checks b once it is in memory */
+static void *openbundle(bundle_t * b, const char *fname, int flags)
+{
+    (void)fname;
+    if (!checkbundle(b, flags))
+    {
+#ifdef VERBOSE
+        fprintf(stderr, "Bundle file '%s' is damaged or was made for"
+                " another version or machine\n", fname);
+#endif
+        fpbundle_Close(b);
+        return NULL;
+    }
+    return b;
+}
+
+extern void *fpbundle_Open(const char *fname, int flags)
+{
+    bundle_t *b = (bundle_t *) calloc(1, sizeof(bundle_t));
+
+    if (!b)
+    {
+        return NULL;
+    }
+#ifdef USEMMAP
+    {
+        int fd = open(fname, O_RDONLY);
+
+        if (fd >= 0)
+        {
+            mapbundle(b, fd, flags);
+            close(fd);
+        }
+    }
+#endif
+    if (!b->data && !readbundle(b, fname))
+    {
+#ifdef VERBOSE
+        fprintf(stderr, "Failed to open bundle file '%s'\n", fname);
+#endif
+        free(b);
+        return NULL;
+    }
+    return openbundle(b, fname, flags);
+}
+
+extern void *fpbundle_OpenFd(int fd, int flags)
+{
+#ifdef USEMMAP
+    bundle_t *b = (bundle_t *) calloc(1, sizeof(bundle_t));
+
+    if (!b)
+    {
+        return NULL;
+    }
+    if (!mapbundle(b, fd, flags))
+    {
+        free(b);
+        return NULL;
+    }
+    return openbundle(b, "(descriptor)", flags);
+#else
+    return NULL;
+#endif
+}
+
+extern void *fpbundle_Use(const void *data, size_t size, int flags)
+{
+    bundle_t *b = (bundle_t *) calloc(1, sizeof(bundle_t));
+
+    if (!b)
+    {
+        return NULL;
+    }
+    b->data = (const char *)data;
+    b->mapsize = size;
+    b->borrowed = 1;
+    return openbundle(b, "(memory)", flags);
+}
+
+#ifdef USEMMAP
+/* names the file st describes, as it is now */
+static void nameversion(const struct stat *st, char *id, size_t size)
+{
+    snprintf(id, size, "<file %lu:%lu %lu %lu>", (unsigned long)st->st_dev,
+             (unsigned long)st->st_ino, (unsigned long)st->st_size,
+             (unsigned long)st->st_mtime);
+}
+#endif
+
+extern int fpbundle_FileId(int fd, char *id, size_t size)
+{
+#ifdef USEMMAP
+    struct stat st;
+
+    if (fstat(fd, &st) != 0)
+    {
+        return 0;
+    }
+    nameversion(&st, id, size);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+extern int fpbundle_FileVersion(const char *fname, char *id, size_t size)
+{
+#ifdef USEMMAP
+    struct stat st;
+
+    if (stat(fname, &st) != 0)
+    {
+        return 0;
+    }
+    nameversion(&st, id, size);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+extern void fpbundle_Close(void *handle)
+{
+    bundle_t *b = (bundle_t *) handle;
+
+    if (b->borrowed)
+    {
+        /*** Not ours ***/
+    }
+#ifdef USEMMAP
+    else if (b->mapped)
+    {
+        munmap((void *)b->data, b->mapsize);
+    }
+#endif
+    else
+    {
+        free((void *)b->data);
+    }
+    free(b);
+}
+
+extern uint4 fpbundle_Size(void *handle)
+{
+    bundle_t *b = (bundle_t *) handle;
+    return ((const header_t *)b->data)->count;
+}
+
+extern void *fpbundle_Fingerprint(void *handle, uint4 i)
+{
+    bundle_t *b = (bundle_t *) handle;
+    const header_t *header = (const header_t *)b->data;
+    const entry_t *entry = (const entry_t *)(b->data + header->entries) + i;
+    fp_t *h = (fp_t *) fp_Init(NULL);
+
+    if (!h)
+    {
+        return NULL;
+    }
+    h->name = b->data + entry->name;
+    h->key = (ngramkey_t *) (b->data + entry->key);
+    h->rank = (sint2 *) (b->data + entry->rank);
+    h->size = h->maxsize = entry->size;
+    h->signature = (uint64_t *) (b->data + entry->signature);
+    memcpy(h->scripts, entry->scripts, sizeof(h->scripts));
+    h->hassignature = 1;
+    h->borrowed = 1;
+    return h;
+}
+
+extern void *fpbundle_Index(void *handle)
+{
+    bundle_t *b = (bundle_t *) handle;
+    const header_t *header = (const header_t *)b->data;
+    const index_t *ix;
+    fpindex_arrays_t arrays;
+
+    if (!header->index)
+    {
+        return NULL;
+    }
+    ix = (const index_t *)(b->data + header->index);
+    indexarrays(b, ix, &arrays);
+    return fpindex_Use(&arrays);
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,141 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _FPBUNDLE_H_
+#define _FPBUNDLE_H_
+/**
+ * fpbundle.h -- a set of fingerprints compiled into one file
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * fpbundle_Write() - Write the size fingerprints fprint, along with
+     * their index if it is not NULL, to the file fname.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int fpbundle_Write(const char *fname, void **fprint, uint4 size,
+                              void *index);
+
+    /**
+     * fpbundle_WriteFd() - Same as fpbundle_Write(), into the file or
+     * shared memory object fd, which is resized to fit. Needs mmap().
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int fpbundle_WriteFd(int fd, void **fprint, uint4 size,
+                                void *index);
+
+    /**
+     * fpbundle_Open() - Map the file fname, written by fpbundle_Write(),
+     * into memory, and check that it is whole and was written for this
+     * version of the library on this kind of machine. flags is a
+     * combination of the TCBUNDLE_ flags of textcat.h.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *fpbundle_Open(const char *fname, int flags);
+
+    /**
+     * fpbundle_OpenFd() - Same as fpbundle_Open() for the file or shared
+     * memory object fd, which can be closed afterwards. Needs mmap().
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *fpbundle_OpenFd(int fd, int flags);
+
+    /**
+     * fpbundle_Use() - Same as fpbundle_Open() for the size bytes at
+     * data, which must stay as they are until fpbundle_Close(), and be
+     * aligned to 8 bytes at least.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *fpbundle_Use(const void *data, size_t size, int flags);
+
+    /**
+     * fpbundle_FileId() - Write a name for the file that fd refers to,
+     * the same for every descriptor of it until the file is written to, to
+     * the size bytes at id.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int fpbundle_FileId(int fd, char *id, size_t size);
+
+    /**
+     * fpbundle_FileVersion() - Same as fpbundle_FileId(), for the file
+     * called fname. A file that is replaced or written to gets another
+     * name, unless that happens within the second it was last written.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int fpbundle_FileVersion(const char *fname, char *id,
+                                    size_t size);
+
+    /**
+     * fpbundle_Close() - Unmap the file. Every fingerprint and index that
+     * was taken from handle must be freed before.
+     */
+    extern void fpbundle_Close(void *handle);
+
+    /**
+     * fpbundle_Size() - The number of fingerprints in handle.
+     */
+    extern uint4 fpbundle_Size(void *handle);
+
+    /**
+     * fpbundle_Fingerprint() - Fingerprint i of handle. Its name, n-grams
+     * and signature stay in the mapped file; free it with fp_Done().
+     *
+     * Returns: fingerprint on success, NULL on error.
+     */
+    extern void *fpbundle_Fingerprint(void *handle, uint4 i);
+
+    /**
+     * fpbundle_Index() - The index of the fingerprints of handle, kept in
+     * the mapped file. Free it with fpindex_Done().
+     *
+     * Returns: index on success, NULL on error or when handle has none.
+     */
+    extern void *fpbundle_Index(void *handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
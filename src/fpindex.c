@@ -0,0 +1,464 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * fpindex.c -- an n-gram index over a set of fingerprints.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * fp_Compare() merges the unknown fingerprint with one known fingerprint
+ * at a time, so classifying against N categories walks the unknown's
+ * n-grams N times. The index turns this around: every distinct n-gram
+ * of the known fingerprints gets a small integer id, and the rank it has
+ * in each fingerprint is stored in row id of a dense matrix (NORANK where
+ * a fingerprint lacks the n-gram). Scoring walks the unknown's n-grams
+ * once; each one that is in the index adds
+ *
+ *   min(|rank in fingerprint - rank in unknown|, MAXOUTOFPLACE)
+ *
+ * to the accumulators of all fingerprints at once, which is a regular
+ * loop over one row that maps directly onto SIMD instructions. Because
+ * NORANK is far away from any real rank, the min() gives missing n-grams
+ * their MAXOUTOFPLACE penalty without a branch. N-grams of the unknown
+ * that are in no fingerprint at all simply cost MAXOUTOFPLACE everywhere.
+ *
+ * Scores are summed in 16-bit lanes for up to BATCHSIZE rows at a time and
+ * then flushed to 32-bit totals.
+ *
+ * The matrix has one row per distinct n-gram, so its size grows with the
+ * product of vocabulary and number of fingerprints. Sets of fingerprints
+ * that would need more than MAXINDEXCELLS cells are not indexed; the
+ * caller then falls back to fp_Compare().
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "common_impl.h"
+#include "constants.h"
+#include "fingerprint_impl.h"
+#include "fpindex.h"
+
+#if MAXNGRAMS > MAXOUTOFPLACE
+#error "the rank matrix relies on rank differences below MAXOUTOFPLACE"
+#endif
+
+/* Rank stored for n-grams that do not occur in a fingerprint */
+#define NORANK 0x7FFF
+
+/* Number of 16-bit lanes in the rows of the matrix */
+#define LANES 8
+
+/* Rows that can be summed before a 16-bit lane may overflow */
+#define BATCHSIZE (0xFFFF / MAXOUTOFPLACE)
+
+#define NOID ((uint4) ~0)
+
+typedef struct
+{
+    uint4 size;                 /* number of indexed fingerprints */
+    uint4 stride;               /* size rounded up to a multiple of LANES */
+    uint4 nngrams;              /* number of distinct n-grams */
+    uint4 mask;                 /* hash table size - 1 */
+    uint4 *slot;                /* n-gram id + 1, or 0 for an empty slot */
+    uint4 *hash;                /* hash value of each n-gram id */
+    ngramkey_t *key;            /* n-gram of each id */
+    sint2 *rank;                /* nngrams rows of stride ranks */
+    boole borrowed;             /* arrays are not ours, see fpindex_Use() */
+} fpindex_t;
+
+static uint4 hashkey(const ngramkey_t * key)
+{
+    uint64_t h = key->w[0] + key->w[1] * 0xC2B2AE3D27D4EB4FULL
+        + key->w[2] * 0x165667B19E3779F9ULL;
+
+    h *= 0x9E3779B97F4A7C15ULL;
+    return (uint4) (h >> 32);
+}
+
+/* returns the id of key, or -1 if it is not in the index */
+static sint4 lookup(const fpindex_t * t, const ngramkey_t * key, uint4 hash)
+{
+    uint4 i = hash & t->mask;
+
+    while (t->slot[i])
+    {
+        uint4 id = t->slot[i] - 1;
+        if (t->hash[id] == hash && KEYEQUAL(t->key[id], *key))
+        {
+            return (sint4) id;
+        }
+        i = (i + 1) & t->mask;
+    }
+    return -1;
+}
+
+/* returns the id of key, adding it to the index when necessary */
+static uint4 insert(fpindex_t * t, const ngramkey_t * key)
+{
+    uint4 hash = hashkey(key);
+    uint4 i = hash & t->mask;
+
+    while (t->slot[i])
+    {
+        uint4 id = t->slot[i] - 1;
+        if (t->hash[id] == hash && KEYEQUAL(t->key[id], *key))
+        {
+            return id;
+        }
+        i = (i + 1) & t->mask;
+    }
+
+    t->hash[t->nngrams] = hash;
+    t->key[t->nngrams] = *key;
+    t->slot[i] = ++t->nngrams;
+    return t->nngrams - 1;
+}
+
+extern void *fpindex_Init(void **fprint, uint4 size)
+{
+    fpindex_t *t;
+    uint4 *ids = NULL;
+    uint4 total = 0;
+    uint4 tablesize = 16;
+    uint4 i, k, n;
+
+    for (i = 0; i < size; i++)
+    {
+        fp_t *fp = (fp_t *) fprint[i];
+        for (k = 0; k < fp->size; k++)
+        {
+            if (fp->rank[k] < 0 || fp->rank[k] >= MAXOUTOFPLACE)
+            {
+                return NULL;
+            }
+        }
+        total += fp->size;
+    }
+    while (tablesize < total * 2)
+    {
+        tablesize <<= 1;
+    }
+
+    t = (fpindex_t *) calloc(1, sizeof(fpindex_t));
+    if (!t)
+    {
+        return NULL;
+    }
+    t->size = size;
+    t->stride = (size + LANES - 1) / LANES * LANES;
+    t->mask = tablesize - 1;
+    t->slot = (uint4 *) calloc(tablesize, sizeof(uint4));
+    t->hash = (uint4 *) malloc(sizeof(uint4) * (total + 1));
+    t->key = (ngramkey_t *) malloc(sizeof(ngramkey_t) * (total + 1));
+    ids = (uint4 *) malloc(sizeof(uint4) * (total + 1));
+    if (!t->slot || !t->hash || !t->key || !ids)
+    {
+        goto BAILOUT;
+    }
+
+    /*** Assign an id to every n-gram ***/
+    for (i = 0, n = 0; i < size; i++)
+    {
+        fp_t *fp = (fp_t *) fprint[i];
+        for (k = 0; k < fp->size; k++)
+        {
+            ids[n++] = insert(t, &fp->key[k]);
+        }
+    }
+
+    /*** Too big to be worth it? ***/
+    if ((double)t->nngrams * t->stride > MAXINDEXCELLS)
+    {
+        goto BAILOUT;
+    }
+
+    t->rank = (sint2 *) malloc(sizeof(sint2) * t->nngrams * t->stride + 1);
+    if (!t->rank)
+    {
+        goto BAILOUT;
+    }
+    for (n = 0; n < t->nngrams * t->stride; n++)
+    {
+        t->rank[n] = NORANK;
+    }
+
+    /*** Fill in the matrix ***/
+    for (i = 0, n = 0; i < size; i++)
+    {
+        fp_t *fp = (fp_t *) fprint[i];
+        for (k = 0; k < fp->size; k++, n++)
+        {
+            sint2 *cell = &t->rank[ids[n] * t->stride + i];
+
+            /*** Duplicate n-gram: fp_Compare() only matches the first ***/
+            if (*cell == NORANK)
+            {
+                *cell = fp->rank[k];
+            }
+        }
+    }
+
+    free(ids);
+    return t;
+
+  BAILOUT:
+    free(ids);
+    fpindex_Done(t);
+    return NULL;
+}
+
+extern void fpindex_Done(void *handle)
+{
+    fpindex_t *t = (fpindex_t *) handle;
+
+    if (!t)
+    {
+        return;
+    }
+    if (!t->borrowed)
+    {
+        free(t->slot);
+        free(t->hash);
+        free(t->key);
+        free(t->rank);
+    }
+    free(t);
+}
+
+extern void fpindex_Arrays(void *handle, fpindex_arrays_t * arrays)
+{
+    fpindex_t *t = (fpindex_t *) handle;
+
+    arrays->size = t->size;
+    arrays->stride = t->stride;
+    arrays->nngrams = t->nngrams;
+    arrays->mask = t->mask;
+    arrays->slot = t->slot;
+    arrays->hash = t->hash;
+    arrays->key = t->key;
+    arrays->rank = t->rank;
+}
+
+/* whether a rank in row is neither NORANK nor in [0, limit) for its lane */
+static boole badrow(const sint2 * row, const sint2 * limit, uint4 stride)
+{
+    uint4 i;
+#ifdef __SSE2__
+    const __m128i vnorank = _mm_set1_epi16(NORANK);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i bad = zero;
+
+    for (i = 0; i < stride; i += LANES)
+    {
+        __m128i r = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i l = _mm_loadu_si128((const __m128i *)(limit + i));
+        __m128i ok = _mm_or_si128(_mm_cmpgt_epi16(l, r),
+                                  _mm_cmpeq_epi16(r, vnorank));
+
+        bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmplt_epi16(r, zero),
+                                             _mm_cmpeq_epi16(ok, zero)));
+    }
+    return _mm_movemask_epi8(bad) != 0;
+#else
+    for (i = 0; i < stride; i++)
+    {
+        if (row[i] != NORANK && (row[i] < 0 || row[i] >= limit[i]))
+        {
+            return 1;
+        }
+    }
+    return 0;
+#endif
+}
+
+extern int fpindex_Check(const fpindex_arrays_t * arrays, const uint4 *sizes)
+{
+    const sint2 *row, *end = arrays->rank
+        + (uint64_t) arrays->nngrams * arrays->stride;
+    sint2 *limit;
+    uint4 col;
+    boole bad = 0;
+    uint64_t n;
+    boole empty = 0;
+
+    /*** As fpindex_Init() lays it out, so row offsets fit in 32 bits ***/
+    if (arrays->stride % LANES != 0 || arrays->stride < arrays->size
+        || arrays->stride >= arrays->size + LANES
+        || (uint64_t) arrays->nngrams * arrays->stride > 0xFFFFFFFFUL)
+    {
+        return 0;
+    }
+
+    /*** lookup() stops at an empty slot, so there must be one ***/
+    for (n = 0; n <= arrays->mask; n++)
+    {
+        if (arrays->slot[n] > arrays->nngrams)
+        {
+            return 0;
+        }
+        empty |= arrays->slot[n] == 0;
+    }
+    if (!empty)
+    {
+        return 0;
+    }
+
+    /*** Every rank is NORANK or below the size of its fingerprint ***/
+    limit = (sint2 *) calloc(arrays->stride + 1, sizeof(sint2));
+    if (!limit)
+    {
+        return 0;
+    }
+    for (col = 0; col < arrays->size; col++)
+    {
+        limit[col] = (sint2) (sizes[col] < NORANK ? sizes[col] : NORANK);
+    }
+    for (row = arrays->rank; row < end && !bad; row += arrays->stride)
+    {
+        bad = badrow(row, (const sint2 *)limit, arrays->stride);
+    }
+    free(limit);
+    return !bad;
+}
+
+extern void *fpindex_Use(const fpindex_arrays_t * arrays)
+{
+    fpindex_t *t;
+
+    if (arrays->stride % LANES != 0 || arrays->stride < arrays->size)
+    {
+        return NULL;
+    }
+    t = (fpindex_t *) calloc(1, sizeof(fpindex_t));
+    if (!t)
+    {
+        return NULL;
+    }
+    t->size = arrays->size;
+    t->stride = arrays->stride;
+    t->nngrams = arrays->nngrams;
+    t->mask = arrays->mask;
+    t->slot = (uint4 *) arrays->slot;
+    t->hash = (uint4 *) arrays->hash;
+    t->key = (ngramkey_t *) arrays->key;
+    t->rank = (sint2 *) arrays->rank;
+    t->borrowed = 1;
+    return t;
+}
+
+/* adds min(|row[i] - rank|, MAXOUTOFPLACE) to acc[i] for every lane */
+static void addrow(uint2 * acc, const sint2 * row, sint2 rank, uint4 stride)
+{
+    uint4 i;
+#ifdef __SSE2__
+    const __m128i vrank = _mm_set1_epi16(rank);
+    const __m128i vmax = _mm_set1_epi16(MAXOUTOFPLACE);
+
+    for (i = 0; i < stride; i += LANES)
+    {
+        __m128i r = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i d = _mm_max_epi16(_mm_subs_epi16(r, vrank),
+                                  _mm_subs_epi16(vrank, r));
+        a = _mm_add_epi16(a, _mm_min_epi16(d, vmax));
+        _mm_storeu_si128((__m128i *) (acc + i), a);
+    }
+#else
+    for (i = 0; i < stride; i++)
+    {
+        sint4 d = abs(row[i] - rank);
+        acc[i] += d < MAXOUTOFPLACE ? d : MAXOUTOFPLACE;
+    }
+#endif
+}
+
+extern uint4 fpindex_AccSize(void *handle)
+{
+    fpindex_t *t = (fpindex_t *) handle;
+    return t->stride;
+}
+
+extern int fpindex_Score(void *handle, void *unknown, sint4 *scores,
+                         uint2 * acc)
+{
+    fpindex_t *t = (fpindex_t *) handle;
+    fp_t *u = (fp_t *) unknown;
+    sint4 missing = 0;
+    uint4 rows = 0;
+    uint4 i, j;
+
+    memset(acc, 0, sizeof(uint2) * t->stride);
+    for (i = 0; i < t->size; i++)
+    {
+        scores[i] = 0;
+    }
+
+    for (j = 0; j < u->size; j++)
+    {
+        const ngramkey_t *key = &u->key[j];
+        sint4 id = lookup(t, key, hashkey(key));
+
+        if (id < 0)
+        {
+            missing += MAXOUTOFPLACE;
+            continue;
+        }
+
+        addrow(acc, &t->rank[id * t->stride], u->rank[j], t->stride);
+
+        /*** Flush before the 16-bit sums can overflow ***/
+        if (++rows == BATCHSIZE)
+        {
+            for (i = 0; i < t->size; i++)
+            {
+                scores[i] += acc[i];
+                acc[i] = 0;
+            }
+            rows = 0;
+        }
+    }
+
+    for (i = 0; i < t->size; i++)
+    {
+        scores[i] += acc[i] + missing;
+    }
+
+    return 1;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _FPINDEX_H_
+#define _FPINDEX_H_
+/**
+ * fpindex.h -- an n-gram index over a set of fingerprints
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * fpindex_Init() - Build an index that gives every n-gram occurring in
+     * the size fingerprints an id, and records its rank in each of them.
+     *
+     * Returns: handle on success, NULL on error or when the fingerprints
+     * would need a matrix larger than MAXINDEXCELLS.
+     */
+    extern void *fpindex_Init(void **fprint, uint4 size);
+
+    /**
+     * fpindex_arrays_t - The arrays that make up an index, see
+     * fpindex_Arrays() and fpindex_Use().
+     */
+    typedef struct
+    {
+        uint4 size;             /* number of indexed fingerprints */
+        uint4 stride;           /* ranks per row */
+        uint4 nngrams;          /* number of rows */
+        uint4 mask;             /* number of slots - 1 */
+        const uint4 *slot;
+        const uint4 *hash;      /* nngrams hash values */
+        const void *key;        /* nngrams n-gram keys */
+        const sint2 *rank;      /* nngrams * stride ranks */
+    } fpindex_arrays_t;
+
+    /**
+     * fpindex_Arrays() - Fill in arrays with those of handle, so that they
+     * can be saved and later handed to fpindex_Use().
+     */
+    extern void fpindex_Arrays(void *handle, fpindex_arrays_t * arrays);
+
+    /**
+     * fpindex_Check() - Check that arrays, which may come from a damaged
+     * file, are an index that fpindex_Score() can use without reading out
+     * of bounds or looping forever. sizes holds the size of each of the
+     * arrays->size fingerprints.
+     *
+     * Returns: 1 if so, 0 if not.
+     */
+    extern int fpindex_Check(const fpindex_arrays_t * arrays,
+                             const uint4 *sizes);
+
+    /**
+     * fpindex_Use() - Make an index of the given arrays, without copying
+     * them. They must stay as they are until fpindex_Done(), which leaves
+     * them alone.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *fpindex_Use(const fpindex_arrays_t * arrays);
+
+    /**
+     * fpindex_Done() - Free up resources for handle
+     */
+    extern void fpindex_Done(void *handle);
+
+    /**
+     * fpindex_AccSize() - The number of accumulators fpindex_Score() needs.
+     */
+    extern uint4 fpindex_AccSize(void *handle);
+
+    /**
+     * fpindex_Score() - Compare the fingerprint unknown with all indexed
+     * fingerprints in a single pass over its n-grams. On return scores[i]
+     * holds what fp_Compare(fprint[i], unknown, MAXSCORE) would give. acc
+     * is scratch space for fpindex_AccSize() accumulators.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int fpindex_Score(void *handle, void *unknown, sint4 *scores,
+                             uint2 * acc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,583 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * fptree.c -- a tree of clusters of fingerprints.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * Fingerprints that are compared one by one cost a merge each, so the
+ * time to classify grows with the number of categories. The tree groups
+ * similar fingerprints, so that whole groups can be passed over.
+ *
+ * Every node covers a set of fingerprints. It keeps the union of their
+ * signatures and the largest of their counts of n-grams per script,
+ * which gives a lower bound on the score of each of them (see
+ * fp_SignatureBound()), and its medoid: the fingerprint closest to the
+ * bitwise majority of their signatures, which stands in for the node.
+ *
+ * The tree is built top down. The fingerprints of a node are split into
+ * up to TREEFANOUT groups around seeds picked far apart from each other,
+ * until at most TREELEAFSIZE fingerprints are left. Distances are those
+ * between signatures, the number of bits in which they differ, which
+ * takes a few dozen instructions where fp_Compare() takes a merge.
+ *
+ * An exact search goes down every branch whose bound is below the
+ * threshold, the best bound first. A beam search only follows the
+ * branches with the best bounds at each level, and scores their medoids
+ * on the way down so that the threshold keeps up.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_impl.h"
+#include "constants.h"
+#include "fingerprint.h"
+#include "fingerprint_impl.h"
+#include "fptree.h"
+
+typedef struct
+{
+    uint4 leaf;                 /* children are fingerprints, not nodes */
+    uint4 first;                /* children are kid[first .. first+count) */
+    uint4 count;
+    uint4 medoid;               /* fingerprint that stands for the node */
+    uint64_t signature[SIGNATUREWORDS]; /* union of those below */
+    uint4 scripts[NSCRIPTS];    /* largest counts of those below */
+} node_t;
+
+typedef struct
+{
+    void **fprint;
+    uint4 size;
+    node_t *node;
+    uint4 nnodes;
+    uint4 root;
+    uint4 *kid;                 /* ids of child nodes or fingerprints */
+    uint4 nkids;
+
+    /*** Scratch space for building ***/
+    uint4 *dist;
+    uint4 *group;
+    uint4 *tmp;
+    uint4 *bitcount;
+} fptree_t;
+
+static uint4 distance(const fp_t * a, const fp_t * b)
+{
+    uint4 d = 0, i;
+
+    for (i = 0; i < SIGNATUREWORDS; i++)
+    {
+        d += POPCOUNT64(a->signature[i] ^ b->signature[i]);
+    }
+    return d;
+}
+
+/* fills in the union, the script counts and the medoid of node */
+static void summarize(fptree_t * t, node_t * node, const uint4 *members,
+                      uint4 n)
+{
+    uint64_t majority[SIGNATUREWORDS];
+    uint4 best = ~(uint4) 0;
+    uint4 i, j;
+
+    memset(node->signature, 0, sizeof(node->signature));
+    memset(node->scripts, 0, sizeof(node->scripts));
+    memset(t->bitcount, 0, sizeof(uint4) * SIGNATUREBITS);
+
+    for (j = 0; j < n; j++)
+    {
+        const fp_t *fp = (const fp_t *) t->fprint[members[j]];
+
+        for (i = 0; i < SIGNATUREWORDS; i++)
+        {
+            uint64_t bits = fp->signature[i];
+
+            node->signature[i] |= bits;
+            for (; bits; bits &= bits - 1)
+            {
+                t->bitcount[i * 64 + POPCOUNT64((bits & (0 - bits)) - 1)]++;
+            }
+        }
+        for (i = 0; i < NSCRIPTS; i++)
+        {
+            node->scripts[i] = WGMAX(node->scripts[i], fp->scripts[i]);
+        }
+    }
+
+    memset(majority, 0, sizeof(majority));
+    for (i = 0; i < SIGNATUREBITS; i++)
+    {
+        if (2 * t->bitcount[i] > n)
+        {
+            majority[i >> 6] |= (uint64_t) 1 << (i & 63);
+        }
+    }
+
+    node->medoid = members[0];
+    for (j = 0; j < n; j++)
+    {
+        const fp_t *fp = (const fp_t *) t->fprint[members[j]];
+        uint4 d = 0;
+
+        for (i = 0; i < SIGNATUREWORDS; i++)
+        {
+            d += POPCOUNT64(fp->signature[i] ^ majority[i]);
+        }
+        if (d < best)
+        {
+            best = d;
+            node->medoid = members[j];
+        }
+    }
+}
+
+/*
+ * Reorders members into groups of similar fingerprints, stores the size
+ * of each group in sizes and returns the number of groups.
+ */
+static uint4 split(fptree_t * t, uint4 *members, uint4 n, uint4 *sizes)
+{
+    const fp_t *seed[TREEFANOUT];
+    uint4 k, j, g, far;
+
+    /*** Pick seeds far apart, starting with the first member ***/
+    seed[0] = (const fp_t *) t->fprint[members[0]];
+    for (j = 0; j < n; j++)
+    {
+        t->dist[j] = distance(seed[0], (const fp_t *) t->fprint[members[j]]);
+    }
+    for (k = 1; k < TREEFANOUT; k++)
+    {
+        for (j = 0, far = 0; j < n; j++)
+        {
+            if (t->dist[j] > t->dist[far])
+            {
+                far = j;
+            }
+        }
+        if (t->dist[far] == 0)
+        {
+            break;
+        }
+        seed[k] = (const fp_t *) t->fprint[members[far]];
+        for (j = 0; j < n; j++)
+        {
+            uint4 d = distance(seed[k], (const fp_t *) t->fprint[members[j]]);
+            t->dist[j] = WGMIN(t->dist[j], d);
+        }
+    }
+
+    memset(sizes, 0, sizeof(uint4) * TREEFANOUT);
+    if (k == 1)
+    {
+        /*** All alike, any split will do ***/
+        k = WGMIN(TREEFANOUT, (n + TREELEAFSIZE - 1) / TREELEAFSIZE);
+        for (j = 0; j < n; j++)
+        {
+            t->group[j] = j * k / n;
+            sizes[t->group[j]]++;
+        }
+    }
+    else
+    {
+        /*** Every member joins its nearest seed ***/
+        for (j = 0; j < n; j++)
+        {
+            const fp_t *fp = (const fp_t *) t->fprint[members[j]];
+            uint4 best = distance(seed[0], fp);
+
+            t->group[j] = 0;
+            for (g = 1; g < k; g++)
+            {
+                uint4 d = distance(seed[g], fp);
+                if (d < best)
+                {
+                    best = d;
+                    t->group[j] = g;
+                }
+            }
+            sizes[t->group[j]]++;
+        }
+    }
+
+    /*** Make the groups contiguous, keeping the order within each ***/
+    {
+        uint4 start[TREEFANOUT];
+
+        for (g = 0, start[0] = 0; g + 1 < k; g++)
+        {
+            start[g + 1] = start[g] + sizes[g];
+        }
+        for (j = 0; j < n; j++)
+        {
+            t->tmp[start[t->group[j]]++] = members[j];
+        }
+        memcpy(members, t->tmp, sizeof(uint4) * n);
+    }
+    return k;
+}
+
+/* builds the subtree of members, returning the id of its root */
+static uint4 build(fptree_t * t, uint4 *members, uint4 n)
+{
+    uint4 id = t->nnodes++;
+    uint4 kids[TREEFANOUT];
+    uint4 sizes[TREEFANOUT];
+    uint4 g, k, nkids = 0;
+
+    summarize(t, &t->node[id], members, n);
+
+    if (n <= TREELEAFSIZE)
+    {
+        t->node[id].leaf = 1;
+        t->node[id].first = t->nkids;
+        t->node[id].count = n;
+        memcpy(&t->kid[t->nkids], members, sizeof(uint4) * n);
+        t->nkids += n;
+        return id;
+    }
+
+    k = split(t, members, n, sizes);
+    for (g = 0; g < k; g++)
+    {
+        if (sizes[g] > 0)
+        {
+            kids[nkids++] = build(t, members, sizes[g]);
+            members += sizes[g];
+        }
+    }
+
+    t->node[id].leaf = 0;
+    t->node[id].first = t->nkids;
+    t->node[id].count = nkids;
+    memcpy(&t->kid[t->nkids], kids, sizeof(uint4) * nkids);
+    t->nkids += nkids;
+    return id;
+}
+
+extern void *fptree_Init(void **fprint, uint4 size)
+{
+    fptree_t *t;
+    uint4 *members = NULL;
+    uint4 i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (!fp_Signature(fprint[i]))
+        {
+            return NULL;
+        }
+    }
+
+    t = (fptree_t *) calloc(1, sizeof(fptree_t));
+    if (!t)
+    {
+        return NULL;
+    }
+    t->fprint = fprint;
+    t->size = size;
+
+    /*** Every split makes at least two children ***/
+    t->node = (node_t *) malloc(sizeof(node_t) * (2 * size + 1));
+    t->kid = (uint4 *) malloc(sizeof(uint4) * (3 * size + 1));
+    members = (uint4 *) malloc(sizeof(uint4) * (size + 1));
+    t->dist = (uint4 *) malloc(sizeof(uint4) * (size + 1));
+    t->group = (uint4 *) malloc(sizeof(uint4) * (size + 1));
+    t->tmp = (uint4 *) malloc(sizeof(uint4) * (size + 1));
+    t->bitcount = (uint4 *) malloc(sizeof(uint4) * SIGNATUREBITS);
+    if (!t->node || !t->kid || !members || !t->dist || !t->group
+        || !t->tmp || !t->bitcount)
+    {
+        free(members);
+        fptree_Done(t);
+        return NULL;
+    }
+
+    for (i = 0; i < size; i++)
+    {
+        members[i] = i;
+    }
+    t->root = build(t, members, size);
+
+    free(members);
+    free(t->dist);
+    free(t->group);
+    free(t->tmp);
+    free(t->bitcount);
+    t->dist = t->group = t->tmp = t->bitcount = NULL;
+    return t;
+}
+
+extern void fptree_Done(void *handle)
+{
+    fptree_t *t = (fptree_t *) handle;
+
+    if (!t)
+    {
+        return;
+    }
+    free(t->node);
+    free(t->kid);
+    free(t->dist);
+    free(t->group);
+    free(t->tmp);
+    free(t->bitcount);
+    free(t);
+}
+
+extern uint4 fptree_WorkSize(void *handle)
+{
+    fptree_t *t = (fptree_t *) handle;
+    return 4 * t->nnodes;
+}
+
+/* the threshold that goes with the best score so far */
+static int threshold(int minscore)
+{
+    if (minscore == MAXSCORE)
+    {
+        return MAXSCORE;
+    }
+    return (int)((double)minscore * THRESHOLDVALUE);
+}
+
+/* scores the fingerprints of a leaf that can still be candidates */
+static uint4 scoreleaf(fptree_t * t, const node_t * node, void *unknown,
+                       uchar * done, sint4 *scores, int *minscore)
+{
+    uint4 j, n = 0;
+
+    for (j = node->first; j < node->first + node->count; j++)
+    {
+        uint4 i = t->kid[j];
+        int cutoff = threshold(*minscore);
+
+        if (done[i] != FPTREE_TODO
+            || fp_Bound(t->fprint[i], unknown) >= cutoff)
+        {
+            continue;
+        }
+        scores[i] = fp_Compare(t->fprint[i], unknown, cutoff);
+        done[i] = FPTREE_SCORED;
+        n++;
+        if (scores[i] < *minscore)
+        {
+            *minscore = scores[i];
+        }
+    }
+    return n;
+}
+
+static sint4 nodebound(const node_t * node, void *unknown)
+{
+    return fp_SignatureBound(node->signature, node->scripts, unknown);
+}
+
+static uint4 exactsearch(fptree_t * t, void *unknown, uchar * done,
+                         sint4 *scores, int *minscore, uint4 *work)
+{
+    uint4 *stack = work;        /* pairs of node id and bound */
+    uint4 sp = 0, n = 0;
+
+    stack[sp++] = t->root;
+    stack[sp++] = (uint4) nodebound(&t->node[t->root], unknown);
+
+    while (sp > 0)
+    {
+        sint4 bound = (sint4) stack[--sp];
+        const node_t *node = &t->node[stack[--sp]];
+        uint4 base = sp, j, k;
+
+        if (bound >= threshold(*minscore))
+        {
+            continue;
+        }
+        if (node->leaf)
+        {
+            n += scoreleaf(t, node, unknown, done, scores, minscore);
+            continue;
+        }
+
+        /*** Push the promising children, the best one on top ***/
+        for (j = node->first; j < node->first + node->count; j++)
+        {
+            uint4 kid = t->kid[j];
+            sint4 b = nodebound(&t->node[kid], unknown);
+
+            if (b >= threshold(*minscore))
+            {
+                continue;
+            }
+            for (k = sp; k > base && (sint4) stack[k - 1] < b; k -= 2)
+            {
+                stack[k] = stack[k - 2];
+                stack[k + 1] = stack[k - 1];
+            }
+            stack[k] = kid;
+            stack[k + 1] = (uint4) b;
+            sp += 2;
+        }
+    }
+    return n;
+}
+
+/*
+ * Scores the medoid of node, if it can still be a candidate, to tighten
+ * the threshold for the levels below.
+ */
+static uint4 scoremedoid(fptree_t * t, const node_t * node, void *unknown,
+                         uchar * done, sint4 *scores, int *minscore)
+{
+    uint4 m = node->medoid;
+    int cutoff = threshold(*minscore);
+
+    if (done[m] != FPTREE_TODO || fp_Bound(t->fprint[m], unknown) >= cutoff)
+    {
+        return 0;
+    }
+    scores[m] = fp_Compare(t->fprint[m], unknown, cutoff);
+    done[m] = FPTREE_SCORED;
+    if (scores[m] < *minscore)
+    {
+        *minscore = scores[m];
+    }
+    return 1;
+}
+
+static uint4 beamsearch(fptree_t * t, void *unknown, uint4 width,
+                        uchar * done, sint4 *scores, int *minscore,
+                        uint4 *work)
+{
+    uint4 *frontier = work;
+    uint4 *next = work + t->nnodes;
+    sint4 *bound = (sint4 *) (work + 2 * t->nnodes);
+    sint4 *estimate = (sint4 *) (work + 3 * t->nnodes);
+    uint4 nfrontier = 1, n = 0;
+
+    frontier[0] = t->root;
+    while (nfrontier > 0)
+    {
+        uint4 nnext = 0, f, j, k;
+
+        /*** The children that the bound does not rule out ***/
+        for (f = 0; f < nfrontier; f++)
+        {
+            const node_t *node = &t->node[frontier[f]];
+
+            /*** The threshold may have dropped since it was let in ***/
+            if (nodebound(node, unknown) >= threshold(*minscore))
+            {
+                continue;
+            }
+            if (node->leaf)
+            {
+                n += scoreleaf(t, node, unknown, done, scores, minscore);
+                continue;
+            }
+            for (j = node->first; j < node->first + node->count; j++)
+            {
+                uint4 kid = t->kid[j];
+                sint4 b = nodebound(&t->node[kid], unknown);
+                uint4 m = t->node[kid].medoid;
+
+                if (b >= threshold(*minscore))
+                {
+                    continue;
+                }
+                next[nnext] = kid;
+                bound[nnext] = b;
+                estimate[nnext++] =
+                    done[m] == FPTREE_SCORED ? scores[m] : MAXSCORE;
+            }
+        }
+
+        if (nnext > width)
+        {
+            /*** Keep the width best by bound, then by medoid score ***/
+            for (k = 0; k < width; k++)
+            {
+                uint4 best = k, tmp;
+                sint4 stmp;
+
+                for (j = k + 1; j < nnext; j++)
+                {
+                    if (bound[j] < bound[best]
+                        || (bound[j] == bound[best]
+                            && estimate[j] < estimate[best]))
+                    {
+                        best = j;
+                    }
+                }
+                tmp = next[k], next[k] = next[best], next[best] = tmp;
+                stmp = bound[k], bound[k] = bound[best], bound[best] = stmp;
+                stmp = estimate[k], estimate[k] = estimate[best],
+                    estimate[best] = stmp;
+            }
+            nnext = width;
+        }
+
+        /*** Their medoids give a threshold to prune the next level ***/
+        for (j = 0; j < nnext; j++)
+        {
+            n += scoremedoid(t, &t->node[next[j]], unknown, done, scores,
+                             minscore);
+        }
+
+        {
+            uint4 *tmp = frontier;
+            frontier = next;
+            next = tmp;
+            nfrontier = nnext;
+        }
+    }
+    return n;
+}
+
+extern uint4 fptree_Search(void *handle, void *unknown, uint4 width,
+                           uchar * done, sint4 *scores, int *minscore,
+                           uint4 *work)
+{
+    fptree_t *t = (fptree_t *) handle;
+
+    if (width == 0)
+    {
+        return exactsearch(t, unknown, done, scores, minscore, work);
+    }
+    return beamsearch(t, unknown, width, done, scores, minscore, work);
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,95 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _FPTREE_H_
+#define _FPTREE_H_
+/**
+ * fptree.h -- a tree of clusters of fingerprints
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * What fptree_Search() finds in done[i] for fingerprint i, and leaves
+     * there.
+     */
+#define FPTREE_TODO 0           /* to be scored, if it can be a candidate */
+#define FPTREE_SKIP 1           /* never to be scored */
+#define FPTREE_SCORED 2         /* scores[i] holds its score */
+
+    /**
+     * fptree_Init() - Cluster the size fingerprints, which must have
+     * signatures, into a tree.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *fptree_Init(void **fprint, uint4 size);
+
+    /**
+     * fptree_Done() - Free up resources for handle
+     */
+    extern void fptree_Done(void *handle);
+
+    /**
+     * fptree_WorkSize() - The number of words of scratch space
+     * fptree_Search() needs.
+     */
+    extern uint4 fptree_WorkSize(void *handle);
+
+    /**
+     * fptree_Search() - Score the fingerprints that can still be
+     * candidates for unknown, going down the tree. *minscore is the best
+     * score so far, and is kept up to date; fingerprints get scored with
+     * the threshold that follows from it, like fp_Compare() does. Scores
+     * go to scores[i], and done[i] becomes FPTREE_SCORED.
+     *
+     * With a width of 0 the search is exact: it only skips branches whose
+     * lower bound rules out all of their fingerprints. Otherwise only the
+     * width branches with the lowest bounds are followed at every level,
+     * which may miss candidates. work is scratch space for fptree_WorkSize() words.
+     *
+     * Returns: the number of fingerprints scored.
+     */
+    extern uint4 fptree_Search(void *handle, void *unknown, uint4 width,
+                               uchar * done, sint4 *scores,
+                               int *minscore, uint4 *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,283 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * script.c -- the Unicode scripts text is written in.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * Characters are mapped to scripts by a sorted table of code point
+ * ranges, covering the scripts of the languages that come with the
+ * library. Letters of other scripts are SCRIPT_OTHER, in the
+ * supplementary planes as much as in the basic one. Symbols, emoji,
+ * numbers and mathematical letters are not in the table and so count as
+ * SCRIPT_COMMON, like punctuation.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+
+#include "common_impl.h"
+#include "script.h"
+
+typedef struct
+{
+    uint4 lo;
+    uint4 hi;
+    script_t script;
+} range_t;
+
+static const range_t ranges[] = {
+    {0x0041, 0x005A, SCRIPT_LATIN},
+    {0x0061, 0x007A, SCRIPT_LATIN},
+    {0x00AA, 0x00AA, SCRIPT_LATIN},
+    {0x00BA, 0x00BA, SCRIPT_LATIN},
+    {0x00C0, 0x00D6, SCRIPT_LATIN},
+    {0x00D8, 0x00F6, SCRIPT_LATIN},
+    {0x00F8, 0x024F, SCRIPT_LATIN},
+    {0x0250, 0x02AF, SCRIPT_LATIN},
+    {0x0370, 0x03FF, SCRIPT_GREEK},
+    {0x0400, 0x052F, SCRIPT_CYRILLIC},
+    {0x0531, 0x058F, SCRIPT_ARMENIAN},
+    {0x0591, 0x05FF, SCRIPT_HEBREW},
+    {0x0600, 0x06FF, SCRIPT_ARABIC},
+    {0x0700, 0x074F, SCRIPT_SYRIAC},
+    {0x0750, 0x077F, SCRIPT_ARABIC},
+    {0x0780, 0x07BF, SCRIPT_THAANA},
+    {0x08A0, 0x08FF, SCRIPT_ARABIC},
+    {0x0900, 0x097F, SCRIPT_DEVANAGARI},
+    {0x0980, 0x09FF, SCRIPT_BENGALI},
+    {0x0A00, 0x0A7F, SCRIPT_GURMUKHI},
+    {0x0A80, 0x0AFF, SCRIPT_GUJARATI},
+    {0x0B00, 0x0B7F, SCRIPT_ORIYA},
+    {0x0B80, 0x0BFF, SCRIPT_TAMIL},
+    {0x0C00, 0x0C7F, SCRIPT_TELUGU},
+    {0x0C80, 0x0CFF, SCRIPT_KANNADA},
+    {0x0D00, 0x0D7F, SCRIPT_MALAYALAM},
+    {0x0D80, 0x0DFF, SCRIPT_SINHALA},
+    {0x0E00, 0x0E7F, SCRIPT_THAI},
+    {0x0E80, 0x0EFF, SCRIPT_LAO},
+    {0x0F00, 0x0FFF, SCRIPT_TIBETAN},
+    {0x1000, 0x109F, SCRIPT_MYANMAR},
+    {0x10A0, 0x10FF, SCRIPT_GEORGIAN},
+    {0x1100, 0x11FF, SCRIPT_HANGUL},
+    {0x1200, 0x139F, SCRIPT_ETHIOPIC},
+    {0x13A0, 0x13FF, SCRIPT_CHEROKEE},
+    {0x1400, 0x167F, SCRIPT_CANADIAN},
+    {0x1780, 0x17FF, SCRIPT_KHMER},
+    {0x1800, 0x18AF, SCRIPT_MONGOLIAN},
+    {0x18B0, 0x18FF, SCRIPT_CANADIAN},
+    {0x19E0, 0x19FF, SCRIPT_KHMER},
+    {0x1C80, 0x1C8F, SCRIPT_CYRILLIC},
+    {0x1C90, 0x1CBF, SCRIPT_GEORGIAN},
+    {0x1D00, 0x1D7F, SCRIPT_LATIN},
+    {0x1E00, 0x1EFF, SCRIPT_LATIN},
+    {0x1F00, 0x1FFF, SCRIPT_GREEK},
+    {0x2C00, 0x2C5F, SCRIPT_OTHER},
+    {0x2C60, 0x2C7F, SCRIPT_LATIN},
+    {0x2C80, 0x2CFF, SCRIPT_OTHER},
+    {0x2D00, 0x2D2F, SCRIPT_GEORGIAN},
+    {0x2DE0, 0x2DFF, SCRIPT_CYRILLIC},
+    {0x2E80, 0x2FDF, SCRIPT_HAN},
+    {0x3005, 0x3007, SCRIPT_HAN},
+    {0x3041, 0x309F, SCRIPT_HIRAGANA},
+    {0x30A0, 0x30FF, SCRIPT_KATAKANA},
+    {0x3130, 0x318F, SCRIPT_HANGUL},
+    {0x31F0, 0x31FF, SCRIPT_KATAKANA},
+    {0x3400, 0x4DBF, SCRIPT_HAN},
+    {0x4E00, 0x9FFF, SCRIPT_HAN},
+    {0xA000, 0xA4CF, SCRIPT_OTHER},
+    {0xA640, 0xA69F, SCRIPT_CYRILLIC},
+    {0xA720, 0xA7FF, SCRIPT_LATIN},
+    {0xA960, 0xA97F, SCRIPT_HANGUL},
+    {0xAB30, 0xAB6F, SCRIPT_LATIN},
+    {0xAC00, 0xD7FF, SCRIPT_HANGUL},
+    {0xF900, 0xFAFF, SCRIPT_HAN},
+    {0xFB00, 0xFB06, SCRIPT_LATIN},
+    {0xFB1D, 0xFB4F, SCRIPT_HEBREW},
+    {0xFB50, 0xFDFF, SCRIPT_ARABIC},
+    {0xFE70, 0xFEFF, SCRIPT_ARABIC},
+    {0xFF21, 0xFF3A, SCRIPT_LATIN},
+    {0xFF41, 0xFF5A, SCRIPT_LATIN},
+    {0xFF66, 0xFF9F, SCRIPT_KATAKANA},
+    {0xFFA0, 0xFFDC, SCRIPT_HANGUL},
+    {0x10000, 0x100FF, SCRIPT_OTHER},
+    {0x10280, 0x1077F, SCRIPT_OTHER},
+    {0x10780, 0x107BF, SCRIPT_LATIN},
+    {0x10800, 0x10E5F, SCRIPT_OTHER},
+    {0x10E80, 0x10FFF, SCRIPT_OTHER},
+    {0x11000, 0x11FBF, SCRIPT_OTHER},
+    {0x11FC0, 0x11FFF, SCRIPT_TAMIL},
+    {0x12000, 0x1254F, SCRIPT_OTHER},
+    {0x12F90, 0x1345F, SCRIPT_OTHER},
+    {0x14400, 0x1467F, SCRIPT_OTHER},
+    {0x16800, 0x16F9F, SCRIPT_OTHER},
+    {0x17000, 0x18D7F, SCRIPT_OTHER},
+    {0x1AFF0, 0x1AFFF, SCRIPT_KATAKANA},
+    {0x1B000, 0x1B154, SCRIPT_HIRAGANA},
+    {0x1B155, 0x1B16F, SCRIPT_KATAKANA},
+    {0x1B170, 0x1B2FF, SCRIPT_OTHER},
+    {0x1BC00, 0x1BC9F, SCRIPT_OTHER},
+    {0x1D800, 0x1DAAF, SCRIPT_OTHER},
+    {0x1DF00, 0x1DFFF, SCRIPT_LATIN},
+    {0x1E000, 0x1E02F, SCRIPT_OTHER},
+    {0x1E030, 0x1E08F, SCRIPT_CYRILLIC},
+    {0x1E100, 0x1E4FF, SCRIPT_OTHER},
+    {0x1E7E0, 0x1E7FF, SCRIPT_ETHIOPIC},
+    {0x1E800, 0x1E95F, SCRIPT_OTHER},
+    {0x20000, 0x3FFFF, SCRIPT_HAN}
+};
+
+#define NRANGES (sizeof(ranges) / sizeof(ranges[0]))
+
+static const char *names[NSCRIPTS] = {
+    "Zyyy", "Latn", "Grek", "Cyrl", "Armn", "Hebr", "Arab", "Syrc", "Thaa",
+    "Deva", "Beng", "Guru", "Gujr", "Orya", "Taml", "Telu", "Knda", "Mlym",
+    "Sinh", "Thai", "Laoo", "Tibt", "Mymr", "Geor", "Hang", "Ethi", "Cher",
+    "Cans", "Khmr", "Mong", "Hira", "Kana", "Hani", "Zzzz"
+};
+
+static script_t lookup(uint4 cp)
+{
+    uint4 lo = 0, hi = NRANGES;
+
+    while (lo < hi)
+    {
+        uint4 mid = (lo + hi) / 2;
+        if (ranges[mid].hi < cp)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    if (lo < NRANGES && ranges[lo].lo <= cp)
+    {
+        return ranges[lo].script;
+    }
+    return SCRIPT_COMMON;
+}
+
+extern script_t script_Of(const char *str, size_t len, uint4 *charlen)
+{
+    const uchar *p = (const uchar *)str;
+    uint4 cp, n, i;
+
+    *charlen = 1;
+    if (p[0] < 0x80)
+    {
+        return lookup(p[0]);
+    }
+    else if (p[0] >= 0xC2 && p[0] <= 0xDF)
+    {
+        n = 2;
+        cp = p[0] & 0x1F;
+    }
+    else if (p[0] >= 0xE0 && p[0] <= 0xEF)
+    {
+        n = 3;
+        cp = p[0] & 0x0F;
+    }
+    else if (p[0] >= 0xF0 && p[0] <= 0xF4)
+    {
+        n = 4;
+        cp = p[0] & 0x07;
+    }
+    else
+    {
+        return SCRIPT_COMMON;
+    }
+
+    if (n > len)
+    {
+        return SCRIPT_COMMON;
+    }
+    for (i = 1; i < n; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            return SCRIPT_COMMON;
+        }
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    *charlen = n;
+    return lookup(cp);
+}
+
+extern script_t script_First(const char *str, size_t len)
+{
+    while (len > 0)
+    {
+        uint4 charlen;
+        script_t script = script_Of(str, len, &charlen);
+
+        if (script != SCRIPT_COMMON)
+        {
+            return script;
+        }
+        str += charlen;
+        len -= charlen;
+    }
+    return SCRIPT_COMMON;
+}
+
+extern void script_Count(const char *buffer, size_t size, uint4 *counts)
+{
+    while (size > 0)
+    {
+        uint4 charlen;
+
+        /*** Plain ascii is by far the most common case ***/
+        if ((uchar) * buffer < 0x80)
+        {
+            uchar c = (uchar) * buffer;
+            counts[(c | 0x20) >= 'a' && (c | 0x20) <= 'z' ?
+                   SCRIPT_LATIN : SCRIPT_COMMON]++;
+            buffer++;
+            size--;
+            continue;
+        }
+        counts[script_Of(buffer, size, &charlen)]++;
+        buffer += charlen;
+        size -= charlen;
+    }
+}
+
+extern const char *script_Name(script_t script)
+{
+    return names[script < NSCRIPTS ? script : SCRIPT_OTHER];
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,118 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+/**
+ * script.h -- the Unicode scripts text is written in
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /*
+     * The scripts told apart. SCRIPT_COMMON covers everything that is not
+     * a letter of some script: spaces, digits, punctuation, symbols and
+     * malformed input.
+     */
+    typedef enum
+    {
+        SCRIPT_COMMON = 0,
+        SCRIPT_LATIN,
+        SCRIPT_GREEK,
+        SCRIPT_CYRILLIC,
+        SCRIPT_ARMENIAN,
+        SCRIPT_HEBREW,
+        SCRIPT_ARABIC,
+        SCRIPT_SYRIAC,
+        SCRIPT_THAANA,
+        SCRIPT_DEVANAGARI,
+        SCRIPT_BENGALI,
+        SCRIPT_GURMUKHI,
+        SCRIPT_GUJARATI,
+        SCRIPT_ORIYA,
+        SCRIPT_TAMIL,
+        SCRIPT_TELUGU,
+        SCRIPT_KANNADA,
+        SCRIPT_MALAYALAM,
+        SCRIPT_SINHALA,
+        SCRIPT_THAI,
+        SCRIPT_LAO,
+        SCRIPT_TIBETAN,
+        SCRIPT_MYANMAR,
+        SCRIPT_GEORGIAN,
+        SCRIPT_HANGUL,
+        SCRIPT_ETHIOPIC,
+        SCRIPT_CHEROKEE,
+        SCRIPT_CANADIAN,
+        SCRIPT_KHMER,
+        SCRIPT_MONGOLIAN,
+        SCRIPT_HIRAGANA,
+        SCRIPT_KATAKANA,
+        SCRIPT_HAN,
+        SCRIPT_OTHER,
+        NSCRIPTS
+    } script_t;
+
+    /**
+     * script_Of() - The script of the utf-8 character at str, which is
+     * at most len bytes long. Stores the length of the character in
+     * *charlen; a malformed byte counts as one SCRIPT_COMMON character.
+     */
+    extern script_t script_Of(const char *str, size_t len, uint4 *charlen);
+
+    /**
+     * script_First() - The script of the first letter in the len bytes at
+     * str, or SCRIPT_COMMON if there is none.
+     */
+    extern script_t script_First(const char *str, size_t len);
+
+    /**
+     * script_Count() - Add the number of characters of each script in the
+     * size bytes at buffer to counts[0 .. NSCRIPTS - 1].
+     */
+    extern void script_Count(const char *buffer, size_t size, uint4 *counts);
+
+    /**
+     * script_Name() - The ISO 15924 code of script, e.g. "Cyrl".
+     */
+    extern const char *script_Name(script_t script);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
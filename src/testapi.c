@@ -0,0 +1,866 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * testapi.c -- checks that the other ways in to the library classify as a
+ * handle made with special_textcat_Init() does.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Usage: testapi mode conffile prefix bundlefile argument...
+ *
+ * mode says what is checked:
+ *
+ * "prefix": the arguments are pairs of a text file and a size shorter
+ * than its text. Classified with that size, the whole zero-terminated
+ * text has to come out as the language the file is named after, and a
+ * batch of the first size bytes as a zero-terminated copy of them.
+ *
+ * "script": the arguments are pairs of a text file and the ISO 15924 code
+ * textcat_ClassifyScript() has to give for it. A few texts of our own
+ * check letters beyond the Basic Multilingual Plane, and that symbols and
+ * digits are no script.
+ *
+ * The other modes take text files, which the handle of other ways in has
+ * to classify as one made with special_textcat_Init():
+ *
+ * "damaged": textcat_InitBundle() on what textcat_WriteBundle() wrote, and
+ * it has to turn the bundle down once it is cut short or a byte of it
+ * is changed.
+ *
+ * "bundlefd": textcat_InitBundleFd() on what textcat_WriteBundleFd()
+ * wrote, with the checksum checked and without. Where there is no mmap()
+ * both have to fail.
+ *
+ * "memory": textcat_InitBundleMemory() on what textcat_WriteBundle()
+ * wrote, with the checksum checked and without, and with a byte changed
+ * it has to turn the bundle down when it checks.
+ *
+ * "builtin": textcat_InitBuiltin(), when the library was configured with
+ * --enable-builtin-models. Otherwise it has to fail.
+ *
+ * "executor": with TCPROP_THREADS and an executor, one by one and in a
+ * batch, before and after textcat_Reload(). The executor has to be used.
+ *
+ * "packed": in a batch and with textcat_ClassifyPacked() on all texts
+ * one after the other in one buffer, on the calling thread and on
+ * TCPROP_THREADS threads.
+ *
+ * "scored": textcat_GetScoredCount() has to count every category the
+ * n-gram index scores, but none that are disabled or that the mask leaves
+ * out, and without the index no more than are enabled.
+ *
+ * "threads": textcat_InitThreads() has to read the same fingerprints as
+ * special_textcat_Init(), byte for byte in a bundle.
+ *
+ * bundlefile is where modes that need a bundle write it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <fcntl.h>
+#include <unistd.h>
+#define USEMMAP
+#endif
+
+#include "textcat.h"
+
+#define THREADS 4
+
+typedef struct
+{
+    const char *name;
+    char *buffer;               /* ends in a zero byte past size */
+    size_t size;
+    int n;                      /* what the reference handle gives, */
+    candidate_t c[TEXTCAT_MAXCANDIDATES];       /* with names of our own */
+} doc_t;
+
+static doc_t *docs;
+static int ndocs;
+static int failures = 0;
+
+static char *readfile(const char *name, size_t *size)
+{
+    FILE *fp = fopen(name, "rb");
+    char *buf;
+    long n;
+
+    if (!fp)
+    {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (n = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    buf = (char *)malloc(n + 1);
+    if (buf && fread(buf, 1, n, fp) != (size_t) n)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    else if (buf)
+    {
+        buf[n] = '\0';
+    }
+    fclose(fp);
+    *size = n;
+    return buf;
+}
+
+static int writefile(const char *name, const char *data, size_t size)
+{
+    FILE *fp = fopen(name, "wb");
+    int ok = fp && fwrite(data, 1, size, fp) == size;
+
+    if (fp && fclose(fp) != 0)
+    {
+        ok = 0;
+    }
+    return ok;
+}
+
+/* tells whether a and b are the same outcome of a classification */
+static boole same(int na, const candidate_t * a, int nb,
+                  const candidate_t * b)
+{
+    int i;
+
+    if (na != nb)
+    {
+        return 0;
+    }
+    for (i = 0; i < na; i++)
+    {
+        if (a[i].score != b[i].score || strcmp(a[i].name, b[i].name) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* reports what went wrong, with doc if it is about one */
+static void fail(const doc_t * doc, const char *what)
+{
+    failures++;
+    fprintf(stderr, "%s%s%s\n", doc ? doc->name : "", doc ? ": " : "", what);
+}
+
+/*
+ * Tells whether category is the language that the file name of doc is
+ * made of, as "de" in ".../de.txt" is of "de--utf8".
+ */
+static boole islanguage(const doc_t * doc, const char *category)
+{
+    const char *base = strrchr(doc->name, '/');
+    size_t len;
+
+    base = base ? base + 1 : doc->name;
+    len = strcspn(base, ".");
+    return strncmp(category, base, len) == 0
+        && (category[len] == '\0' || category[len] == '-');
+}
+
+/*
+ * size limits the normalized text, not how much of the buffer is read,
+ * while a batch reads no further than size bytes.
+ */
+static void checkprefix(void *h, doc_t * doc)
+{
+    candidate_t c[TEXTCAT_MAXCANDIDATES], copied[TEXTCAT_MAXCANDIDATES];
+    candidate_t batched[TEXTCAT_MAXCANDIDATES];
+    textcat_span_t span;
+    char *copy;
+    int n, ncopied, nbatched;
+
+    n = textcat_ClassifyFull(h, doc->buffer, doc->size, c);
+    if (n <= 0 || !islanguage(doc, c[0].name))
+    {
+        fail(doc, "prefix not classified as its language");
+    }
+
+    copy = (char *)malloc(doc->size + 1);
+    if (!copy)
+    {
+        fail(doc, "out of memory");
+        return;
+    }
+    memcpy(copy, doc->buffer, doc->size);
+    copy[doc->size] = '\0';
+    ncopied = textcat_ClassifyFull(h, copy, doc->size, copied);
+    free(copy);
+
+    span.buffer = doc->buffer;
+    span.size = doc->size;
+    if (!textcat_ClassifyBatch(h, &span, 1, batched, &nbatched))
+    {
+        fail(doc, "batch failed");
+    }
+    else if (!same(nbatched, batched, ncopied, copied))
+    {
+        fail(doc, "batch differs from a zero-terminated copy");
+    }
+}
+
+/* texts of our own for ClassifyScript(), with what it has to give */
+static const struct
+{
+    const char *text;
+    const char *script;
+} scripts[] =
+{
+    /*** Symbols beyond the BMP are no letters ***/
+    { "Hello \xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80 world",
+      "Latn" },
+    /*** Cyrillic Extended-D, U+1E030 ***/
+    { "\xF0\x9E\x80\xB0\xF0\x9E\x80\xB1 1", "Cyrl" },
+    /*** CJK Extension B, U+20000 ***/
+    { "\xF0\xA0\x80\x80\xF0\xA0\x80\x81 x", "Hani" },
+    { "12345 !!", TEXTCAT_RESULT_SHORT_STR },
+    { NULL, NULL }
+};
+
+/* checks the script h gives for doc, or for our own texts without one */
+static void checkscript(void *h, const doc_t * doc, const char *expected)
+{
+    const char *script;
+    int i;
+
+    if (doc)
+    {
+        script = textcat_ClassifyScript(h, doc->buffer, doc->size);
+        if (strcmp(script, expected) != 0)
+        {
+            fprintf(stderr, "%s: script %s, not %s\n", doc->name, script,
+                    expected);
+            failures++;
+        }
+        return;
+    }
+    for (i = 0; scripts[i].text; i++)
+    {
+        script = textcat_ClassifyScript(h, scripts[i].text,
+                                        strlen(scripts[i].text));
+        if (strcmp(script, scripts[i].script) != 0)
+        {
+            fprintf(stderr, "text %d: script %s, not %s\n", i, script,
+                    scripts[i].script);
+            failures++;
+        }
+    }
+}
+
+/*
+ * Reads the text files, and how the reference handle h classifies them.
+ * The names are copied, so that they outlive h.
+ */
+static int readdocs(void *h, char **names, int count)
+{
+    int i, k;
+
+    ndocs = count;
+    docs = (doc_t *) calloc(ndocs ? ndocs : 1, sizeof(doc_t));
+    for (i = 0; docs && i < ndocs; i++)
+    {
+        docs[i].name = names[i];
+        docs[i].buffer = readfile(names[i], &docs[i].size);
+        if (!docs[i].buffer)
+        {
+            fprintf(stderr, "Unable to read '%s'\n", names[i]);
+            return 0;
+        }
+        docs[i].n = textcat_ClassifyFull(h, docs[i].buffer, docs[i].size,
+                                         docs[i].c);
+        for (k = 0; k < docs[i].n; k++)
+        {
+            docs[i].c[k].name = strdup(docs[i].c[k].name);
+            if (!docs[i].c[k].name)
+            {
+                docs[i].n = k;
+                return 0;
+            }
+        }
+    }
+    return docs != NULL;
+}
+
+/* checks that h classifies every document as the reference handle does */
+static void checkdocs(void *h, const char *what)
+{
+    candidate_t c[TEXTCAT_MAXCANDIDATES];
+    int i, n;
+
+    for (i = 0; i < ndocs; i++)
+    {
+        n = textcat_ClassifyFull(h, docs[i].buffer, docs[i].size, c);
+        if (!same(n, c, docs[i].n, docs[i].c))
+        {
+            fail(&docs[i], what);
+        }
+    }
+}
+
+/* checks that the first size bytes of bundle make no bundlefile */
+static void checkdamaged(const char *bundlefile, const char *bundle,
+                         size_t size, const char *what)
+{
+    void *h;
+
+    if (!writefile(bundlefile, bundle, size))
+    {
+        fail(NULL, "unable to write a damaged bundle");
+    }
+    else if ((h = textcat_InitBundle(bundlefile)) != NULL)
+    {
+        fail(NULL, what);
+        textcat_Done(h);
+    }
+}
+
+/* a bundle classifies as the conf file it was written from */
+static void checkbundle(void *h, const char *bundlefile)
+{
+    size_t size, at[3];
+    char *bundle;
+    void *b;
+    int i;
+
+    bundle = textcat_WriteBundle(h, bundlefile)
+        ? readfile(bundlefile, &size) : NULL;
+    b = bundle ? textcat_InitBundle(bundlefile) : NULL;
+    if (!b)
+    {
+        fail(NULL, "unable to init from the bundle");
+        free(bundle);
+        return;
+    }
+    checkdocs(b, "classification from a bundle differs");
+    textcat_Done(b);
+
+    checkdamaged(bundlefile, bundle, 16, "bundle of 16 bytes taken");
+    checkdamaged(bundlefile, bundle, size / 2, "half a bundle taken");
+    checkdamaged(bundlefile, bundle, size - 1, "bundle a byte short taken");
+    at[0] = 0;
+    at[1] = size / 2;
+    at[2] = size - 1;
+    for (i = 0; i < 3; i++)
+    {
+        bundle[at[i]] ^= 0x55;
+        checkdamaged(bundlefile, bundle, size, "bundle with a byte changed"
+                     " taken");
+        bundle[at[i]] ^= 0x55;
+    }
+    free(bundle);
+}
+
+/* a bundle in a file descriptor classifies as its conf file */
+static void checkbundlefd(void *h, const char *bundlefile)
+{
+#ifdef USEMMAP
+    static const int flags[] = { 0, TCBUNDLE_TRUSTED | TCBUNDLE_WILLNEED };
+    void *b;
+    int fd, i;
+
+    fd = open(bundlefile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || !textcat_WriteBundleFd(h, fd))
+    {
+        fail(NULL, "unable to write the bundle to a descriptor");
+    }
+    if (fd < 0 || close(fd) != 0)
+    {
+        return;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        /*** Closed right away, as the handle keeps the mapping ***/
+        fd = open(bundlefile, O_RDONLY);
+        b = fd >= 0 ? textcat_InitBundleFd(fd, flags[i]) : NULL;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        if (!b)
+        {
+            fail(NULL, "unable to init from a descriptor");
+            continue;
+        }
+        checkdocs(b, "classification from a descriptor differs");
+        textcat_Done(b);
+    }
+#else
+    void *b = textcat_InitBundleFd(0, 0);
+
+    (void)bundlefile;
+    if (b || textcat_WriteBundleFd(h, 1))
+    {
+        fail(NULL, "bundle in a descriptor without mmap()");
+    }
+    if (b)
+    {
+        textcat_Done(b);
+    }
+#endif
+}
+
+/* a bundle in memory classifies as the conf file it was written from */
+static void checkmemory(void *h, const char *bundlefile)
+{
+    static const int flags[] = { 0, TCBUNDLE_TRUSTED };
+    char *bundle;
+    size_t size;
+    void *b;
+    int i;
+
+    /*** malloc() aligns to 8 bytes at least ***/
+    bundle = textcat_WriteBundle(h, bundlefile)
+        ? readfile(bundlefile, &size) : NULL;
+    if (!bundle)
+    {
+        fail(NULL, "unable to write the bundle");
+        return;
+    }
+    for (i = 0; i < 2; i++)
+    {
+        b = textcat_InitBundleMemory(bundle, size, flags[i]);
+        if (!b)
+        {
+            fail(NULL, "unable to init from memory");
+            continue;
+        }
+        checkdocs(b, "classification from memory differs");
+        textcat_Done(b);
+    }
+
+    bundle[size / 2] ^= 0x55;
+    b = textcat_InitBundleMemory(bundle, size, 0);
+    if (b)
+    {
+        fail(NULL, "bundle in memory with a byte changed taken");
+        textcat_Done(b);
+    }
+    free(bundle);
+}
+
+/* the fingerprints compiled in classify as those of the conf file */
+static void checkbuiltin(void)
+{
+    void *b = textcat_InitBuiltin();
+
+#ifdef ENABLE_BUILTIN_MODELS
+    if (!b)
+    {
+        fail(NULL, "unable to init from the builtin fingerprints");
+        return;
+    }
+    checkdocs(b, "classification from the builtin fingerprints differs");
+#else
+    if (b)
+    {
+        fail(NULL, "builtin fingerprints where none were compiled in");
+    }
+#endif
+    if (b)
+    {
+        textcat_Done(b);
+    }
+}
+
+/* checks that a batch of all documents on h comes out as the reference */
+static void checkbatch(void *h, const char *what)
+{
+    textcat_span_t *spans;
+    candidate_t *candidates;
+    int *results, i;
+
+    spans = (textcat_span_t *) malloc(sizeof(textcat_span_t) * ndocs);
+    candidates = (candidate_t *) malloc(sizeof(candidate_t) * ndocs
+                                        * TEXTCAT_MAXCANDIDATES);
+    results = (int *)malloc(sizeof(int) * ndocs);
+    if (!spans || !candidates || !results)
+    {
+        fail(NULL, "out of memory");
+    }
+    else
+    {
+        for (i = 0; i < ndocs; i++)
+        {
+            spans[i].buffer = docs[i].buffer;
+            spans[i].size = docs[i].size;
+        }
+        if (!textcat_ClassifyBatch(h, spans, ndocs, candidates, results))
+        {
+            fail(NULL, "batch failed");
+        }
+        for (i = 0; i < ndocs; i++)
+        {
+            if (!same(results[i], &candidates[i * TEXTCAT_MAXCANDIDATES],
+                      docs[i].n, docs[i].c))
+            {
+                fail(&docs[i], what);
+            }
+        }
+    }
+    free(spans);
+    free(candidates);
+    free(results);
+}
+
+/*
+ * checks that all documents packed into one buffer, with nothing between
+ * them, come out as the reference
+ */
+static void checkpacked(void *h, const char *what)
+{
+    candidate_t *candidates;
+    size_t *offsets;
+    char *buffer;
+    int *results, i;
+
+    offsets = (size_t *) malloc(sizeof(size_t) * (ndocs + 1));
+    candidates = (candidate_t *) malloc(sizeof(candidate_t) * ndocs
+                                        * TEXTCAT_MAXCANDIDATES);
+    results = (int *)malloc(sizeof(int) * ndocs);
+    buffer = NULL;
+    if (offsets)
+    {
+        offsets[0] = 0;
+        for (i = 0; i < ndocs; i++)
+        {
+            offsets[i + 1] = offsets[i] + docs[i].size;
+        }
+        buffer = (char *)malloc(offsets[ndocs] + 1);
+    }
+    if (!offsets || !candidates || !results || !buffer)
+    {
+        fail(NULL, "out of memory");
+    }
+    else
+    {
+        for (i = 0; i < ndocs; i++)
+        {
+            memcpy(buffer + offsets[i], docs[i].buffer, docs[i].size);
+        }
+        if (!textcat_ClassifyPacked(h, buffer, offsets, ndocs, candidates,
+                                    results))
+        {
+            fail(NULL, "packed batch failed");
+        }
+        for (i = 0; i < ndocs; i++)
+        {
+            if (!same(results[i], &candidates[i * TEXTCAT_MAXCANDIDATES],
+                      docs[i].n, docs[i].c))
+            {
+                fail(&docs[i], what);
+            }
+        }
+    }
+    free(offsets);
+    free(candidates);
+    free(results);
+    free(buffer);
+}
+
+/* runs the parts last to first, and counts how often it is called */
+static void executor(void *data, textcat_Task task, void *arg, uint4 nparts)
+{
+    uint4 part;
+
+    (*(int *)data)++;
+    for (part = nparts; part > 0; part--)
+    {
+        task(arg, part - 1);
+    }
+}
+
+/* an executor classifies as the library does on its own */
+static void checkexecutor(void *h)
+{
+    int calls = 0;
+
+    textcat_SetProperty(h, TCPROP_THREADS, THREADS);
+    textcat_SetExecutor(h, executor, &calls);
+    checkdocs(h, "classification with an executor differs");
+    checkbatch(h, "batch with an executor differs");
+    if (!textcat_Reload(h))
+    {
+        fail(NULL, "reload with an executor failed");
+    }
+    checkdocs(h, "classification with an executor differs after a reload");
+    checkbatch(h, "batch with an executor differs after a reload");
+    if (calls == 0)
+    {
+        fail(NULL, "executor not used");
+    }
+}
+
+/* checks the categories h scored for each document with context */
+static void checkcount(void *h, void *context, void *mask, int low, int high,
+                       const char *what)
+{
+    candidate_t c[TEXTCAT_MAXCANDIDATES];
+    char message[128];
+    int i, n;
+
+    for (i = 0; i < ndocs; i++)
+    {
+        if (mask)
+        {
+            textcat_ClassifyFullWithMask(h, context, mask, docs[i].buffer,
+                                         docs[i].size, c);
+        }
+        else
+        {
+            textcat_ClassifyFullWithContext(h, context, docs[i].buffer,
+                                            docs[i].size, c);
+        }
+        n = textcat_GetScoredCount(h, context);
+        if (n < low || n > high)
+        {
+            snprintf(message, sizeof(message), "%d categories scored, %s", n,
+                     what);
+            fail(&docs[i], message);
+        }
+    }
+}
+
+/* the n-gram index of h scores what is enabled and allowed, and no more */
+static void checkscored(void *h, const char *conffile, const char *prefix)
+{
+    static const char *names[] = { "en", "de", "fr", "nl", "sco", NULL };
+    void *context, *mask, *lazy;
+    int all;
+
+    all = textcat_SetEnabled(h, NULL, 1);
+    context = textcat_GetContext(h);
+    mask = textcat_GetMask(h, names);
+    if (all <= 0 || !context || !mask)
+    {
+        fail(NULL, "unable to count the categories");
+    }
+    else
+    {
+        checkcount(h, context, NULL, all, all, "not all of them");
+        checkcount(h, context, mask, 5, 5, "not those of the mask");
+        if (textcat_SetEnabled(h, "en", 0) != 1)
+        {
+            fail(NULL, "unable to disable a category");
+        }
+        checkcount(h, context, NULL, all - 1, all - 1,
+                   "not all that are enabled");
+        checkcount(h, context, mask, 4, 4,
+                   "not those of the mask that are enabled");
+    }
+    if (mask)
+    {
+        textcat_ReleaseMask(h, mask);
+    }
+    if (context)
+    {
+        textcat_ReleaseContext(h, context);
+    }
+
+    lazy = textcat_InitLazy(conffile, prefix);
+    context = lazy ? textcat_GetContext(lazy) : NULL;
+    if (!context)
+    {
+        fail(NULL, "unable to init lazily");
+    }
+    else
+    {
+        checkcount(lazy, context, NULL, 1, all, "more than there are");
+        textcat_ReleaseContext(lazy, context);
+    }
+    if (lazy)
+    {
+        textcat_Done(lazy);
+    }
+}
+
+/*
+ * Fingerprints read on several threads are those read on one. The model
+ * of h is freed first, so that it cannot be shared.
+ */
+static void checkthreads(void *h, const char *conffile, const char *prefix,
+                         const char *bundlefile)
+{
+    char *serial, *threaded;
+    size_t nserial, nthreaded;
+
+    serial = textcat_WriteBundle(h, bundlefile)
+        ? readfile(bundlefile, &nserial) : NULL;
+    textcat_Done(h);
+    h = textcat_InitThreads(conffile, prefix, THREADS);
+    threaded = h && textcat_WriteBundle(h, bundlefile)
+        ? readfile(bundlefile, &nthreaded) : NULL;
+    if (!serial || !threaded)
+    {
+        fail(NULL, "unable to write the bundles");
+    }
+    else if (nserial != nthreaded || memcmp(serial, threaded, nserial) != 0)
+    {
+        fail(NULL, "fingerprints read on threads differ");
+    }
+    if (h)
+    {
+        checkdocs(h, "classification on threads differs");
+        textcat_Done(h);
+    }
+    free(serial);
+    free(threaded);
+}
+
+int main(int argc, char **argv)
+{
+    doc_t doc;
+    void *h;
+    int i;
+
+    if (argc < 5)
+    {
+        fprintf(stderr, "Usage: %s mode conffile prefix bundlefile"
+                " argument...\n", argv[0]);
+        return 2;
+    }
+    h = special_textcat_Init(argv[2], argv[3]);
+    if (!h)
+    {
+        fprintf(stderr, "Unable to init using '%s', Aborting.\n", argv[2]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "prefix") == 0)
+    {
+        for (i = 5; i + 1 < argc; i += 2)
+        {
+            size_t size;
+
+            doc.name = argv[i];
+            doc.buffer = readfile(argv[i], &size);
+            doc.size = strtoul(argv[i + 1], NULL, 10);
+            if (!doc.buffer || doc.size >= size)
+            {
+                fprintf(stderr, "Unable to read '%s' for a prefix\n",
+                        argv[i]);
+                return 1;
+            }
+            checkprefix(h, &doc);
+            free(doc.buffer);
+        }
+    }
+    else if (strcmp(argv[1], "script") == 0)
+    {
+        for (i = 5; i + 1 < argc; i += 2)
+        {
+            doc.name = argv[i];
+            doc.buffer = readfile(argv[i], &doc.size);
+            if (!doc.buffer)
+            {
+                fprintf(stderr, "Unable to read '%s'\n", argv[i]);
+                return 1;
+            }
+            checkscript(h, &doc, argv[i + 1]);
+            free(doc.buffer);
+        }
+        checkscript(h, NULL, NULL);
+    }
+    else if (!readdocs(h, argv + 5, argc - 5))
+    {
+        return 1;
+    }
+    else if (strcmp(argv[1], "damaged") == 0)
+    {
+        checkbundle(h, argv[4]);
+    }
+    else if (strcmp(argv[1], "bundlefd") == 0)
+    {
+        checkbundlefd(h, argv[4]);
+    }
+    else if (strcmp(argv[1], "memory") == 0)
+    {
+        checkmemory(h, argv[4]);
+    }
+    else if (strcmp(argv[1], "builtin") == 0)
+    {
+        checkbuiltin();
+    }
+    else if (strcmp(argv[1], "executor") == 0)
+    {
+        checkexecutor(h);
+    }
+    else if (strcmp(argv[1], "packed") == 0)
+    {
+        checkbatch(h, "batch differs");
+        checkpacked(h, "packed batch differs");
+        textcat_SetProperty(h, TCPROP_THREADS, THREADS);
+        checkbatch(h, "batch on threads differs");
+        checkpacked(h, "packed batch on threads differs");
+    }
+    else if (strcmp(argv[1], "scored") == 0)
+    {
+        checkscored(h, argv[2], argv[3]);
+    }
+    else if (strcmp(argv[1], "threads") == 0)
+    {
+        checkthreads(h, argv[2], argv[3], argv[4]);
+        h = NULL;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown mode '%s'\n", argv[1]);
+        failures++;
+    }
+
+    if (h)
+    {
+        textcat_Done(h);
+    }
+    for (i = 0; i < ndocs; i++)
+    {
+        int k;
+
+        for (k = 0; k < docs[i].n; k++)
+        {
+            free((char *)docs[i].c[k].name);
+        }
+        free(docs[i].buffer);
+    }
+    free(docs);
+    return failures ? 1 : 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,399 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * testreload.c -- checks that classifications come out the same while
+ * other threads reload the fingerprints with textcat_Reload() and change
+ * what their own sessions have enabled.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Usage: testreload mode conffile prefix bundlefile textfile...
+ *
+ * mode says what the handle is made from: "conf" for special_textcat_Init(),
+ * "lazy" for textcat_InitLazy(), or "bundle" for textcat_InitBundle() on
+ * bundlefile, which is written from conffile first. Every text file is
+ * classified whole, with a mask and in a batch, on the handle before
+ * anything else happens; the sessions then have to give the very same
+ * results over and over, as does textcat_ClassifyFull() on the handle
+ * from all their threads at once, while the fingerprints are reloaded
+ * under them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "textcat.h"
+#include "common_impl.h"
+
+#define NWORKERS 4
+#define NRELOADS 8
+
+typedef struct
+{
+    const char *name;
+    char *buffer;
+    size_t size;
+    int nfull;                  /* what the whole text gives */
+    candidate_t full[TEXTCAT_MAXCANDIDATES];
+    int nmasked;                /* what it gives with the mask */
+    candidate_t masked[TEXTCAT_MAXCANDIDATES];
+} doc_t;
+
+static doc_t *docs;
+static uint4 ndocs;
+static const char *masknames[] = { "en", "de", "fr", "nl", "sco", NULL };
+
+static void *shared;            /* the handle the sessions are of */
+static int stop = 0;
+static int failures = 0;
+
+static char *readfile(const char *name, size_t *size)
+{
+    FILE *fp = fopen(name, "rb");
+    char *buf;
+    long n;
+
+    if (!fp)
+    {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (n = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    buf = (char *)malloc(n + 1);
+    if (buf && fread(buf, 1, n, fp) != (size_t) n)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    else if (buf)
+    {
+        buf[n] = '\0';
+    }
+    fclose(fp);
+    *size = n;
+    return buf;
+}
+
+/* tells whether a and b are the same outcome of a classification */
+static boole same(int na, const candidate_t * a, int nb,
+                  const candidate_t * b)
+{
+    int i;
+
+    if (na != nb)
+    {
+        return 0;
+    }
+    for (i = 0; i < na; i++)
+    {
+        if (a[i].score != b[i].score || strcmp(a[i].name, b[i].name) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* reports what went wrong, with doc if it is about one */
+static void fail(const doc_t * doc, const char *what)
+{
+    WGATOMICINC(&failures);
+    fprintf(stderr, "%s%s%s\n", doc ? doc->name : "", doc ? ": " : "", what);
+}
+
+/*
+ * Classifies every document on h in every way, and records the outcomes,
+ * or checks them against those recorded when check.
+ */
+static void classifyall(void *h, void *context, void *mask, boole check)
+{
+    textcat_span_t *spans;
+    candidate_t *candidates, c[TEXTCAT_MAXCANDIDATES];
+    int *results;
+    uint4 i;
+    int n;
+
+    for (i = 0; i < ndocs; i++)
+    {
+        n = textcat_ClassifyFullWithContext(h, context, docs[i].buffer,
+                                            docs[i].size, c);
+        if (!check)
+        {
+            docs[i].nfull = n;
+            memcpy(docs[i].full, c, sizeof(c));
+        }
+        else if (!same(n, c, docs[i].nfull, docs[i].full))
+        {
+            fail(&docs[i], "classification differs");
+        }
+
+        /*** On the one handle all threads share, as it is allowed to ***/
+        n = textcat_ClassifyFull(shared, docs[i].buffer, docs[i].size, c);
+        if (check && !same(n, c, docs[i].nfull, docs[i].full))
+        {
+            fail(&docs[i], "classification on the shared handle differs");
+        }
+
+        n = textcat_ClassifyFullWithMask(h, context, mask, docs[i].buffer,
+                                         docs[i].size, c);
+        if (!check)
+        {
+            docs[i].nmasked = n;
+            memcpy(docs[i].masked, c, sizeof(c));
+        }
+        else if (!same(n, c, docs[i].nmasked, docs[i].masked))
+        {
+            fail(&docs[i], "masked classification differs");
+        }
+    }
+
+    spans = (textcat_span_t *) malloc(sizeof(textcat_span_t) * ndocs);
+    candidates = (candidate_t *) malloc(sizeof(candidate_t) * ndocs
+                                        * TEXTCAT_MAXCANDIDATES);
+    results = (int *)malloc(sizeof(int) * ndocs);
+    if (!spans || !candidates || !results)
+    {
+        fail(NULL, "out of memory");
+    }
+    else
+    {
+        for (i = 0; i < ndocs; i++)
+        {
+            spans[i].buffer = docs[i].buffer;
+            spans[i].size = docs[i].size;
+        }
+        if (!textcat_ClassifyBatch(h, spans, ndocs, candidates, results))
+        {
+            fail(NULL, "batch failed");
+        }
+        for (i = 0; i < ndocs; i++)
+        {
+            if (!same(results[i],
+                      &candidates[i * TEXTCAT_MAXCANDIDATES], docs[i].nfull,
+                      docs[i].full))
+            {
+                fail(&docs[i], "batch classification differs");
+            }
+        }
+    }
+    free(spans);
+    free(candidates);
+    free(results);
+}
+
+typedef struct
+{
+    void *session;
+    void *context;
+    void *mask;
+} worker_t;
+
+/* classifies on a session until told to stop */
+static void *classifier(void *arg)
+{
+    worker_t *w = (worker_t *) arg;
+
+    do
+    {
+        classifyall(w->session, w->context, w->mask, 1);
+    }
+    while (!WGATOMICACQUIRE(&stop));
+    return NULL;
+}
+
+/* reloads the handle until told to stop */
+static void *reloader(void *arg)
+{
+    worker_t *w = (worker_t *) arg;
+
+    while (!WGATOMICACQUIRE(&stop))
+    {
+        if (!textcat_Reload(w->session))
+        {
+            fail(NULL, "reload failed");
+        }
+    }
+    return NULL;
+}
+
+/* turns a language of its session off and on until told to stop */
+static void *toggler(void *arg)
+{
+    worker_t *w = (worker_t *) arg;
+    uint4 i;
+
+    for (i = 0; !WGATOMICACQUIRE(&stop); i++)
+    {
+        if (textcat_SetEnabled(w->session, "en", i & 1) <= 0)
+        {
+            fail(NULL, "enabling failed");
+        }
+    }
+    return NULL;
+}
+
+static void *makehandle(const char *mode, const char *conffile,
+                        const char *prefix, const char *bundlefile)
+{
+    void *h;
+
+    if (strcmp(mode, "lazy") == 0)
+    {
+        return textcat_InitLazy(conffile, prefix);
+    }
+    h = special_textcat_Init(conffile, prefix);
+    if (!h || strcmp(mode, "bundle") != 0)
+    {
+        return h;
+    }
+    if (!textcat_WriteBundle(h, bundlefile))
+    {
+        textcat_Done(h);
+        return NULL;
+    }
+    textcat_Done(h);
+    return textcat_InitBundle(bundlefile);
+}
+
+int main(int argc, char **argv)
+{
+    worker_t w[NWORKERS + 2];
+    void *h, *context, *mask;
+    uint4 i;
+#ifdef HAVE_PTHREAD_H
+    pthread_t t[NWORKERS + 2];
+#endif
+
+    if (argc < 6)
+    {
+        fprintf(stderr, "Usage: %s conf|lazy|bundle conffile prefix"
+                " bundlefile textfile...\n", argv[0]);
+        return 2;
+    }
+    h = makehandle(argv[1], argv[2], argv[3], argv[4]);
+    if (!h)
+    {
+        fprintf(stderr, "Unable to init using '%s', Aborting.\n", argv[2]);
+        return 1;
+    }
+
+    ndocs = argc - 5;
+    docs = (doc_t *) calloc(ndocs, sizeof(doc_t));
+    for (i = 0; docs && i < ndocs; i++)
+    {
+        docs[i].name = argv[i + 5];
+        docs[i].buffer = readfile(argv[i + 5], &docs[i].size);
+        if (!docs[i].buffer)
+        {
+            fprintf(stderr, "Unable to read '%s'\n", argv[i + 5]);
+            return 1;
+        }
+    }
+
+    /*** What a reload has to carry over ***/
+    textcat_SetEnabled(h, "sco", 0);
+    textcat_SetProperty(h, TCPROP_THREADS, 2);
+    mask = textcat_GetMask(h, masknames);
+    context = textcat_GetContext(h);
+    shared = h;
+    classifyall(h, context, mask, 0);
+
+    for (i = 0; i < NWORKERS + 2; i++)
+    {
+        w[i].session = i == NWORKERS ? h : textcat_NewSession(h);
+        w[i].context = textcat_GetContext(w[i].session);
+        w[i].mask = mask;
+    }
+#ifdef HAVE_PTHREAD_H
+    for (i = 0; i < NWORKERS; i++)
+    {
+        pthread_create(&t[i], NULL, classifier, &w[i]);
+    }
+    pthread_create(&t[NWORKERS], NULL, reloader, &w[NWORKERS]);
+    pthread_create(&t[NWORKERS + 1], NULL, toggler, &w[NWORKERS + 1]);
+    for (i = 0; i < NRELOADS; i++)
+    {
+        if (!textcat_Reload(w[i % NWORKERS].session))
+        {
+            fail(NULL, "reload failed");
+        }
+    }
+    WGATOMICPUBLISH(&stop, 1);
+    for (i = 0; i < NWORKERS + 2; i++)
+    {
+        pthread_join(t[i], NULL);
+    }
+#else
+    for (i = 0; i < NRELOADS; i++)
+    {
+        if (!textcat_Reload(w[i % NWORKERS].session))
+        {
+            fail(NULL, "reload failed");
+        }
+        classifyall(w[i % NWORKERS].session, w[i % NWORKERS].context, mask,
+                    1);
+    }
+#endif
+
+    /*** And once more when everything is quiet ***/
+    classifyall(h, context, mask, 1);
+
+    for (i = 0; i < NWORKERS + 2; i++)
+    {
+        textcat_ReleaseContext(w[i].session, w[i].context);
+        if (w[i].session != h)
+        {
+            textcat_Done(w[i].session);
+        }
+    }
+    textcat_ReleaseMask(h, mask);
+    textcat_ReleaseContext(h, context);
+    textcat_Done(h);
+    for (i = 0; i < ndocs; i++)
+    {
+        free(docs[i].buffer);
+    }
+    free(docs);
+
+    return failures ? 1 : 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
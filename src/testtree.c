@@ -0,0 +1,217 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/*
+ * testtree.c -- checks that the beam search of the tree of fingerprints
+ * mostly finds what the exact search finds, and scores fewer of them.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Usage: testtree conffile prefix bundlefile width textfile...
+ *
+ * The fingerprints listed in conffile are written to bundlefile without
+ * an n-gram index, so that the handle made from it searches a tree. Each
+ * text file is then classified with the exact search and with a beam of
+ * the given width. The beam has to give the same best category for at
+ * least MINSAMETOP percent of the texts, and score fewer fingerprints
+ * than the exact search in all.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "textcat.h"
+#include "common_impl.h"
+#include "constants.h"
+#include "fingerprint.h"
+#include "fpbundle.h"
+
+#define MINSAMETOP 90
+
+static char *readfile(const char *name, size_t *size)
+{
+    FILE *fp = fopen(name, "rb");
+    char *buf;
+    long n;
+
+    if (!fp)
+    {
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (n = ftell(fp)) < 0
+        || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    buf = (char *)malloc(n + 1);
+    if (buf && fread(buf, 1, n, fp) != (size_t) n)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    else if (buf)
+    {
+        buf[n] = '\0';
+    }
+    fclose(fp);
+    *size = n;
+    return buf;
+}
+
+/*
+ * Writes the fingerprints listed in conffile to bundlefile, without an
+ * index.
+ */
+static int writetree(const char *conffile, const char *prefix,
+                     const char *bundlefile)
+{
+    FILE *fp = fopen(conffile, "r");
+    char line[1024], file[512], name[512], path[1024];
+    void **fprint = NULL;
+    uint4 size = 0, i;
+    int ok = fp != NULL;
+
+    while (ok && fgets(line, sizeof(line), fp))
+    {
+        void **tmp;
+
+        if (line[0] == '#' || sscanf(line, "%511s %511s", file, name) < 2)
+        {
+            continue;
+        }
+        tmp = (void **)realloc(fprint, sizeof(void *) * (size + 1));
+        if (!tmp)
+        {
+            ok = 0;
+            break;
+        }
+        fprint = tmp;
+        fprint[size] = fp_Init(name);
+        snprintf(path, sizeof(path), "%s%s", prefix, file);
+        ok = fprint[size] && fp_Read(fprint[size], path, MAXNGRAMS);
+        if (fprint[size])
+        {
+            size++;
+        }
+    }
+    if (fp)
+    {
+        fclose(fp);
+    }
+
+    ok = ok && size > 0 && fpbundle_Write(bundlefile, fprint, size, NULL);
+    for (i = 0; i < size; i++)
+    {
+        fp_Done(fprint[i]);
+    }
+    free(fprint);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    candidate_t c[TEXTCAT_MAXCANDIDATES];
+    unsigned long exact = 0, beam = 0;
+    void *h, *context;
+    uint4 width, ndocs = 0, sametop = 0;
+    int i, failures = 0;
+
+    if (argc < 6)
+    {
+        fprintf(stderr, "Usage: %s conffile prefix bundlefile width"
+                " textfile...\n", argv[0]);
+        return 2;
+    }
+    width = strtoul(argv[4], NULL, 10);
+    if (!writetree(argv[1], argv[2], argv[3]))
+    {
+        fprintf(stderr, "Unable to write '%s', Aborting.\n", argv[3]);
+        return 1;
+    }
+    h = textcat_InitBundle(argv[3]);
+    context = h ? textcat_GetContext(h) : NULL;
+    if (!context)
+    {
+        fprintf(stderr, "Unable to init using '%s', Aborting.\n", argv[3]);
+        return 1;
+    }
+
+    for (i = 5; i < argc; i++)
+    {
+        char best[MAXOUTPUTSIZE];
+        size_t size;
+        char *buffer = readfile(argv[i], &size);
+        int n;
+
+        if (!buffer)
+        {
+            fprintf(stderr, "Unable to read '%s'\n", argv[i]);
+            return 1;
+        }
+
+        textcat_SetProperty(h, TCPROP_BEAM_WIDTH, 0);
+        n = textcat_ClassifyFullWithContext(h, context, buffer, size, c);
+        exact += textcat_GetScoredCount(h, context);
+        strcpy(best, n > 0 ? c[0].name : "");
+
+        textcat_SetProperty(h, TCPROP_BEAM_WIDTH, width);
+        n = textcat_ClassifyFullWithContext(h, context, buffer, size, c);
+        beam += textcat_GetScoredCount(h, context);
+        if (strcmp(best, n > 0 ? c[0].name : "") == 0)
+        {
+            sametop++;
+        }
+        ndocs++;
+        free(buffer);
+    }
+
+    if (sametop * 100 < ndocs * MINSAMETOP)
+    {
+        fprintf(stderr, "width %u: same best category for %u of %u texts\n",
+                width, sametop, ndocs);
+        failures++;
+    }
+    if (beam >= exact)
+    {
+        fprintf(stderr, "width %u: scored %lu fingerprints, exact %lu\n",
+                width, beam, exact);
+        failures++;
+    }
+
+    textcat_ReleaseContext(h, context);
+    textcat_Done(h);
+    return failures ? 1 : 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -47,9 +47,6 @@
  * IMPROVEMENTS:
  * - If two n-grams have the same frequency count, choose the shortest
  * - Use a better similarity measure (the article suggests Wilcoxon rank test)
- * - The profiles are matched one by one, which results in redundant lookups.
- * - Make the thingy reentrant as well as thread-safe. (Reentrancy is abandoned
- *   by the use of the output buffer in textcat_t.)
  */
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -57,27 +54,214 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 #include "common_impl.h"
 #include "fingerprint.h"
+#include "fingerprint_impl.h"
+#include "fpbundle.h"
+#include "fpindex.h"
+#include "fptree.h"
+#include "script.h"
 #include "textcat.h"
 #include "constants.h"
+#include "wg_threadpool.h"
 
 
-typedef struct
+/*
+ * The categories loaded from a configuration file. Nothing changes them
+ * after loading but the atomic win counts, so all handles made from the
+ * same configuration file and prefix share one model, on any thread.
+ */
+typedef struct model_s
 {
+    char *conffile;             /* what the model was loaded from */
+    char *prefix;               /* NULL for a bundle */
+    char *version;              /* of the file conffile, see sharemodel() */
+    uint4 refs;                 /* slots using it, see LOCKMODELS() */
+    uint4 serial;               /* tells models apart, see fitcontext() */
+    boole fixed;                /* from memory or a descriptor */
+    struct model_s *next;       /* next in the list of loaded models */
 
     void **fprint;
-    unsigned char *fprint_disable;
+    void *index;
+    void *tree;                 /* used when there is no index */
     uint4 size;
-    uint4 maxsize;
+    uint4 *wins;                /* how often each category came out best */
+    void *bundle;               /* that fprint and index are kept in */
+
+    /*** Only when loaded lazily, see loadfingerprint() ***/
+    char **path;                /* of the file of each fingerprint */
+    uint4 *state;               /* NOTREAD, READ or UNREADABLE */
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;       /* held while reading a fingerprint */
+#endif
+} model_t;
+
+/* states of a lazily loaded fingerprint */
+#define NOTREAD 0
+#define READ 1
+#define UNREADABLE 2
+
+/*** The models that are loaded, so that they can be shared ***/
+static model_t *models = NULL;
+static uint4 lastserial = 0;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t modellock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCKMODELS() pthread_mutex_lock(&modellock)
+#define UNLOCKMODELS() pthread_mutex_unlock(&modellock)
+#else
+#define LOCKMODELS()
+#define UNLOCKMODELS()
+#endif
+
+/*
+ * Threads that a handle and its sessions share. A handle with
+ * TCPROP_THREADS set to n splits its work into n parts at most, so it
+ * never keeps more than n - 1 of them busy, however many there are.
+ */
+typedef struct
+{
+    void *threads;              /* see wgthreadpool_Init() */
+    uint4 nthreads;
+    uint4 refs;                 /* the slot and handles using it */
+} pool_t;
+
+/*
+ * What a handle shares with its sessions: their threads, and the model
+ * they classify with, which textcat_Reload() replaces while they do. The
+ * model of generation g is model[g & 1], and a classification counts
+ * itself in readers[g & 1] for as long as it uses that model, see
+ * enter(). A reload fills in the other half, moves on to the next
+ * generation, and then waits until nobody reads the old half any more.
+ * Classifications thus never wait for a reload, and a reload only waits
+ * for classifications that started before it.
+ */
+typedef struct
+{
+    uint4 generation;
+    uint4 readers[2];
+    model_t *model[2];
+    const char **names[2];      /* of the categories, see internnames() */
+    uint4 *ids[2];              /* of the categories among the interned */
+
+    char **interned;            /* every name ever reported */
+    uint4 ninterned;
+    uint4 maxinterned;
+
+    struct textcat_s *handles;  /* the handle and its sessions */
+    pool_t *pool;               /* the largest so far, see usepool() */
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_t lock;       /* held to add, remove or reload handles */
+    pthread_mutex_t reloadlock; /* held by a reload until it freed a half */
+#endif
+} slot_t;
+
+/*
+ * A handle: the slot it classifies with, plus its properties and the
+ * memory that textcat_Classify() and textcat_ClassifyFull() work with.
+ * Handles are cheap, so every thread can have one of its own, see
+ * textcat_NewSession().
+ */
+typedef struct textcat_s
+{
+    slot_t *slot;
+    struct textcat_s *next;     /* next handle of the slot */
+
+    /*** For the model of each half of the slot ***/
+    unsigned char *fprint_disable[2];
+    uint4 *active[2];           /* the categories not disabled, in order */
+    uint4 nactive[2];
     uint4 mindocsize;
 
     char output[MAXOUTPUTSIZE];
     candidate_t *tmp_candidates;
+    void *tmp_context;
+    void *spare;                /* textcat_ClassifyFull() reuses, or NULL */
     boole utfaware;
+    boole adaptive;             /* TCPROP_ADAPTIVE_ORDER */
+    uint4 beamwidth;            /* TCPROP_BEAM_WIDTH */
+    uint4 threads;              /* TCPROP_THREADS */
+    textcat_Executor executor;  /* runs parts of the work, or NULL */
+    void *executordata;
+    pool_t *pool;               /* threads when there is no executor */
 } textcat_t;
 
+/*
+ * What one classification works with: the model of the generation it
+ * started in, and what the handle keeps for that model.
+ */
+typedef struct
+{
+    model_t *model;
+    void **fprint;
+    void *index;
+    void *tree;                 /* used when there is no index */
+    uint4 size;
+    uint4 *wins;
+    const uint4 *active;
+    uint4 nactive;
+    const char **names;
+    const uint4 *ids;
+} view_t;
+
+/*
+ * A language mask, see textcat_GetMask(): which of the names that slot
+ * interned a classification may report.
+ */
+typedef struct
+{
+    slot_t *slot;
+    uint4 size;
+    uchar *allow;
+} mask_t;
+
+typedef struct
+{
+    uint4 first;                /* position among the frequent winners */
+    sint4 bound;
+    uint4 i;
+} bound_t;
+
+/*
+ * Everything a classification writes to, so that a stream of
+ * classifications can reuse the memory instead of allocating it anew.
+ */
+typedef struct
+{
+    uint4 serial;               /* of the model the memory is sized for */
+    void *unknown;              /* fingerprint of the buffer */
+    sint4 *scores;              /* scores from the n-gram index or tree */
+    uint2 *acc;                 /* accumulators for fpindex_Score() */
+    uchar *done;                /* state of each category in the tree */
+    uint4 *work;                /* scratch space for fptree_Search() */
+    uint4 scored;               /* categories compared with the buffer */
+    bound_t *bound;             /* lower bounds on scores, see fp_Bound() */
+    uint4 *active;              /* categories that a mask allows */
+    uint4 first[ADAPTIVEFIRST]; /* frequent winners, best first */
+    uint4 nfirst;
+    uint4 calls;                /* classifications since the last look */
+} textcat_context_t;
+
+/*
+ * Comparing one by one on several threads: part p compares every
+ * nparts-th category in order of bound, starting at p.
+ */
+typedef struct
+{
+    textcat_t *h;
+    const view_t *v;
+    textcat_context_t *c;
+    uint4 nbound;               /* categories that take part */
+    uint4 nparts;
+    int minscore;               /* best score so far, shared by the parts */
+    uint4 scored;
+} job_t;
+
 
 static int cmpcandidates(const void *a, const void *b)
 {
@@ -86,22 +270,483 @@ static int cmpcandidates(const void *a, const void *b)
     return (x->score - y->score);
 }
 
+static int cmpbounds(const void *a, const void *b)
+{
+    const bound_t *x = (const bound_t *)a;
+    const bound_t *y = (const bound_t *)b;
 
-extern void textcat_Done(void *handle)
+    if (x->first != y->first)
+    {
+        return x->first < y->first ? -1 : 1;
+    }
+    if (x->bound != y->bound)
+    {
+        return x->bound < y->bound ? -1 : 1;
+    }
+    return x->i < y->i ? -1 : x->i > y->i;
+}
+
+
+static char *copystring(const char *str)
+{
+    char *copy = (char *)malloc(strlen(str) + 1);
+
+    if (copy)
+    {
+        strcpy(copy, str);
+    }
+    return copy;
+}
+
+static void freemodel(model_t * m)
+{
+    uint4 i;
+
+    for (i = 0; i < m->size; i++)
+    {
+        fp_Done(m->fprint[i]);
+    }
+    fpindex_Done(m->index);
+    fptree_Done(m->tree);
+    free(m->wins);
+    free(m->fprint);
+    if (m->path)
+    {
+        for (i = 0; i < m->size; i++)
+        {
+            free(m->path[i]);
+        }
+        free(m->path);
+    }
+    if (m->state)
+    {
+        free(m->state);
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_destroy(&m->lock);
+#endif
+    }
+    free(m->conffile);
+    free(m->prefix);
+    free(m->version);
+    if (m->bundle)
+    {
+        fpbundle_Close(m->bundle);
+    }
+    free(m);
+}
+
+/* drops a reference to m, and frees it when it was the last one */
+static void releasemodel(model_t * m)
+{
+    model_t **p;
+    uint4 refs;
+
+    LOCKMODELS();
+    refs = --m->refs;
+    if (refs == 0)
+    {
+        for (p = &models; *p != m; p = &(*p)->next)
+        {
+        }
+        *p = m->next;
+    }
+    UNLOCKMODELS();
+
+    if (refs == 0)
+    {
+        freemodel(m);
+    }
+}
+
+/*
+ * Reads fingerprint i of m, if m was loaded lazily and nobody did yet,
+ * and tells whether it can be used. Once a fingerprint is read, it stays
+ * as it is, so that only the first use takes the lock.
+ */
+static boole loadfingerprint(model_t * m, uint4 i)
+{
+    uint4 state;
+
+    if (!m->state)
+    {
+        return 1;
+    }
+    state = WGATOMICACQUIRE(&m->state[i]);
+    if (state == NOTREAD)
+    {
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock(&m->lock);
+#endif
+        state = m->state[i];
+        if (state == NOTREAD)
+        {
+            state = fp_Read(m->fprint[i], m->path[i], 400) ? READ : UNREADABLE;
+            WGATOMICPUBLISH(&m->state[i], state);
+        }
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock(&m->lock);
+#endif
+    }
+    return state == READ;
+}
+
+#ifdef HAVE_PTHREAD_H
+#define LOCKSLOT(s) pthread_mutex_lock(&(s)->lock)
+#define UNLOCKSLOT(s) pthread_mutex_unlock(&(s)->lock)
+#define LOCKRELOAD(s) pthread_mutex_lock(&(s)->reloadlock)
+#define UNLOCKRELOAD(s) pthread_mutex_unlock(&(s)->reloadlock)
+#else
+#define LOCKSLOT(s)
+#define UNLOCKSLOT(s)
+#define LOCKRELOAD(s)
+#define UNLOCKRELOAD(s)
+#endif
+
+/*
+ * Starts using the current model of h, which v then shows, without
+ * taking a lock. A reload that moves on to the next generation between
+ * reading it and counting ourselves in sends us round again. Returns the
+ * half of the slot to pass to leave().
+ */
+static uint4 enter(textcat_t * h, view_t * v)
+{
+    slot_t *s = h->slot;
+    uint4 g, half;
+    model_t *m;
+
+    for (;;)
+    {
+        g = WGATOMICACQUIRE(&s->generation);
+        half = g & 1;
+        WGATOMICSYNCADD(&s->readers[half], 1);
+        if (WGATOMICSYNCGET(&s->generation) == g)
+        {
+            break;
+        }
+        WGATOMICSYNCADD(&s->readers[half], (uint4) -1);
+    }
+
+    m = s->model[half];
+    v->model = m;
+    v->fprint = m->fprint;
+    v->index = m->index;
+    v->tree = m->tree;
+    v->size = m->size;
+    v->wins = m->wins;
+    v->active = h->active[half];
+    v->nactive = h->nactive[half];
+    v->names = s->names[half];
+    v->ids = s->ids[half];
+    return half;
+}
+
+/* stops using the model that enter() gave */
+static void leave(textcat_t * h, uint4 half)
+{
+    WGATOMICSYNCADD(&h->slot->readers[half], (uint4) -1);
+}
+
+/*
+ * Waits until no classification uses half of s. The caller holds
+ * LOCKRELOAD() but not LOCKSLOT(), so that handles can still be added,
+ * removed and changed meanwhile.
+ */
+static void waitreaders(slot_t * s, uint4 half)
+{
+    while (WGATOMICSYNCGET(&s->readers[half]) != 0)
+    {
+#ifdef HAVE_PTHREAD_H
+        sched_yield();
+#endif
+    }
+}
+
+/*
+ * Gives the names of the categories of m, as kept by s, so that the names
+ * that classifications report outlive the model, and sets ids to where
+ * they are kept. Names that were there before, as in old with oldids for
+ * a model of oldsize categories, are shared.
+ */
+static const char **internnames(slot_t * s, model_t * m, const char **old,
+                                const uint4 * oldids, uint4 oldsize,
+                                uint4 ** ids)
+{
+    const char **names =
+        (const char **)malloc(sizeof(const char *) * (m->size + 1));
+    uint4 i, k;
+
+    *ids = (uint4 *) malloc(sizeof(uint4) * (m->size + 1));
+    if (!names || !*ids)
+    {
+        free(names);
+        free(*ids);
+        *ids = NULL;
+        return NULL;
+    }
+    for (i = 0; i < m->size; i++)
+    {
+        const char *name = fp_Name(m->fprint[i]);
+
+        if (old && i < oldsize && strcmp(old[i], name) == 0)
+        {
+            names[i] = old[i];
+            (*ids)[i] = oldids[i];
+            continue;
+        }
+        for (k = 0; k < s->ninterned; k++)
+        {
+            if (strcmp(s->interned[k], name) == 0)
+            {
+                break;
+            }
+        }
+        if (k == s->ninterned)
+        {
+            if (s->ninterned == s->maxinterned)
+            {
+                uint4 maxinterned = s->maxinterned ? s->maxinterned * 2 : 64;
+                char **tmp = (char **)realloc(s->interned,
+                                              sizeof(char *) * maxinterned);
+
+                if (!tmp)
+                {
+                    free(names);
+                    free(*ids);
+                    *ids = NULL;
+                    return NULL;
+                }
+                s->interned = tmp;
+                s->maxinterned = maxinterned;
+            }
+            s->interned[k] = copystring(name);
+            if (!s->interned[k])
+            {
+                free(names);
+                free(*ids);
+                *ids = NULL;
+                return NULL;
+            }
+            s->ninterned++;
+        }
+        names[i] = s->interned[k];
+        (*ids)[i] = k;
+    }
+    return names;
+}
+
+/*
+ * Carries the categories that old disabled for the categories oldnames
+ * over to the categories names of the next model, by name.
+ */
+static unsigned char *carrydisable(const unsigned char *old,
+                                   const char **oldnames, uint4 oldsize,
+                                   const char **names, uint4 size)
+{
+    unsigned char *disable =
+        (unsigned char *)malloc(sizeof(unsigned char) * (size + 1));
+    uint4 i, k;
+
+    if (!disable)
+    {
+        return NULL;
+    }
+    for (i = 0; i < size; i++)
+    {
+        disable[i] = 0xF0;
+        if (i < oldsize && oldnames[i] == names[i])
+        {
+            disable[i] = old[i];
+            continue;
+        }
+        for (k = 0; k < oldsize; k++)
+        {
+            /*** Interned, so equal names are the same string ***/
+            if (oldnames[k] == names[i])
+            {
+                disable[i] = old[k];
+                break;
+            }
+        }
+    }
+    return disable;
+}
+
+/*
+ * Lists the categories of h that disable leaves enabled for the model of
+ * half, in order, so that classifications skip the others for free.
+ */
+static boole listactive(textcat_t * h, uint4 half,
+                        const unsigned char *disable, uint4 size)
+{
+    uint4 *active = (uint4 *) malloc(sizeof(uint4) * (size + 1));
+    uint4 i, n = 0;
+
+    if (!active)
+    {
+        return 0;
+    }
+    for (i = 0; i < size; i++)
+    {
+        if (!(disable[i] & 0x0F))
+        {
+            active[n++] = i;
+        }
+    }
+    free(h->active[half]);
+    h->active[half] = active;
+    h->nactive[half] = n;
+    return 1;
+}
+
+static void freeslot(slot_t * s)
 {
-    textcat_t *h = (textcat_t *) handle;
     uint4 i;
 
-    for (i = 0; i < h->size; i++)
+    for (i = 0; i < 2; i++)
+    {
+        if (s->model[i])
+        {
+            releasemodel(s->model[i]);
+        }
+        free((void *)s->names[i]);
+        free(s->ids[i]);
+    }
+    for (i = 0; i < s->ninterned; i++)
+    {
+        free(s->interned[i]);
+    }
+    free(s->interned);
+    if (s->pool && --s->pool->refs == 0)
+    {
+        wgthreadpool_Done(s->pool->threads);
+        free(s->pool);
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&s->lock);
+    pthread_mutex_destroy(&s->reloadlock);
+#endif
+    free(s);
+}
+
+/* drops a reference to p, and stops its threads when it was the last */
+static void releasepool(slot_t * s, pool_t * p)
+{
+    uint4 refs;
+
+    if (!p)
+    {
+        return;
+    }
+    LOCKSLOT(s);
+    refs = --p->refs;
+    UNLOCKSLOT(s);
+    if (refs == 0)
+    {
+        wgthreadpool_Done(p->threads);
+        free(p);
+    }
+}
+
+/* starts a pool of nthreads threads, with one reference */
+static pool_t *newpool(uint4 nthreads)
+{
+    pool_t *p = (pool_t *) malloc(sizeof(pool_t));
+
+    if (!p)
+    {
+        return NULL;
+    }
+    p->threads = wgthreadpool_Init(nthreads);
+    if (!p->threads)
+    {
+        free(p);
+        return NULL;
+    }
+    p->nthreads = nthreads;
+    p->refs = 1;
+    return p;
+}
+
+/*
+ * Gives h the threads it needs for TCPROP_THREADS, unless it has an
+ * executor. The threads of the slot do when there are enough of them;
+ * otherwise the slot gets a larger pool, and the smaller one stops once
+ * the handles that use it let go of it.
+ */
+static void usepool(textcat_t * h)
+{
+    slot_t *s = h->slot;
+    uint4 nthreads = h->threads - 1;
+    pool_t *p = NULL, *old = NULL;
+
+    releasepool(s, h->pool);
+    h->pool = NULL;
+    if (nthreads == 0 || h->executor)
+    {
+        return;
+    }
+
+    LOCKSLOT(s);
+    if (s->pool && s->pool->nthreads >= nthreads)
+    {
+        p = s->pool;
+        p->refs++;
+    }
+    UNLOCKSLOT(s);
+
+    if (!p)
     {
-        fp_Done(h->fprint[i]);
+        /*** Starting threads takes a while; do it outside the lock ***/
+        p = newpool(nthreads);
+        if (!p)
+        {
+            return;
+        }
+
+        LOCKSLOT(s);
+        if (!s->pool || s->pool->nthreads < nthreads)
+        {
+            old = s->pool;
+            s->pool = p;
+            p->refs++;
+        }
+        UNLOCKSLOT(s);
+        releasepool(s, old);
     }
+    h->pool = p;
+}
+
+extern void textcat_Done(void *handle)
+{
+    textcat_t *h = (textcat_t *) handle;
+    slot_t *s = h->slot;
+    textcat_t **p;
+    boole last;
+
     if (h->tmp_candidates != NULL)
     {
         textcat_ReleaseClassifyFullOutput(h, h->tmp_candidates);
     }
-    free(h->fprint);
-    free(h->fprint_disable);
+    textcat_ReleaseContext(h, h->tmp_context);
+    textcat_ReleaseContext(h, h->spare);
+    releasepool(s, h->pool);
+
+    LOCKSLOT(s);
+    for (p = &s->handles; *p != h; p = &(*p)->next)
+    {
+    }
+    *p = h->next;
+    last = s->handles == NULL;
+    UNLOCKSLOT(s);
+    if (last)
+    {
+        freeslot(s);
+    }
+
+    free(h->fprint_disable[0]);
+    free(h->fprint_disable[1]);
+    free(h->active[0]);
+    free(h->active[1]);
     free(h);
 
 }
@@ -128,28 +773,135 @@ extern int textcat_SetProperty(void *handle, textcat_Property property,
         }
         return -2;
         break;
+    case TCPROP_ADAPTIVE_ORDER:
+        if ((value == TC_TRUE) || (value == TC_FALSE))
+        {
+            h->adaptive = value;
+            return 0;
+        }
+        return -2;
+        break;
+    case TCPROP_BEAM_WIDTH:
+        if (value >= 0)
+        {
+            h->beamwidth = value;
+            return 0;
+        }
+        return -2;
+        break;
+    case TCPROP_THREADS:
+        if (value >= 1 && value <= MAXTHREADS)
+        {
+            h->threads = value;
+            usepool(h);
+            return 0;
+        }
+        return -2;
+        break;
     default:
         break;
     }
     return -1;
 }
 
-/** Replaces older function */
-extern void *textcat_Init(const char *conffile)
+extern void textcat_SetExecutor(void *handle, textcat_Executor executor,
+                                void *data)
 {
-    return special_textcat_Init(conffile, DEFAULT_FINGERPRINTS_PATH);
+    textcat_t *h = (textcat_t *) handle;
+
+    h->executor = executor;
+    h->executordata = data;
+    usepool(h);
 }
 
-/**
- * Originaly this function had only one parameter (conffile) it has been modified since OOo use
- * Basicaly prefix is the directory path where fingerprints are stored
+/** Replaces older function */
+extern void *textcat_Init(const char *conffile)
+{
+    return special_textcat_Init(conffile, DEFAULT_FINGERPRINTS_PATH);
+}
+
+/*
+ * Where a bundle is: in memory at data, in fd when that is not -1, or
+ * else in the file that loadbundle() is given. For a configuration file,
+ * the handle whose threads or executor read the fingerprint files, or
+ * else threads to read them on, if any.
  */
-extern void *special_textcat_Init(const char *conffile, const char *prefix)
+typedef struct
 {
-    textcat_t *h;
+    const void *data;
+    size_t size;
+    int fd;
+    int flags;                  /* TCBUNDLE_ flags */
+    const textcat_t *reader;    /* see readmodel() */
+    void *threads;              /* see wgthreadpool_Init() */
+} source_t;
+
+typedef struct
+{
+    model_t *m;
+    boole *ok;
+} readjob_t;
+
+static void readpart(void *arg, uint4 part)
+{
+    readjob_t *job = (readjob_t *) arg;
+
+    job->ok[part] = fp_Read(job->m->fprint[part], job->m->path[part], 400);
+}
+
+/*
+ * Reads all fingerprint files of m, on the calling thread, or on the
+ * threads or executor of the reader of src when there is one, or on the
+ * threads of src. Every file has a slot of its own, so the outcome does
+ * not depend on which thread reads what.
+ */
+static boole readmodel(model_t * m, const source_t * src)
+{
+    const textcat_t *reader = src ? src->reader : NULL;
+    readjob_t job;
+    boole ok = 1;
+    uint4 i;
+
+    job.m = m;
+    job.ok = (boole *) malloc(sizeof(boole) * (m->size + 1));
+    if (!job.ok)
+    {
+        return 0;
+    }
+    if (reader && reader->executor)
+    {
+        reader->executor(reader->executordata, readpart, &job, m->size);
+    }
+    else
+    {
+        wgthreadpool_Run(reader && reader->pool ? reader->pool->threads :
+                         src ? src->threads : NULL, readpart, &job, m->size);
+    }
+
+    for (i = 0; i < m->size; i++)
+    {
+        ok = ok && job.ok[i];
+        free(m->path[i]);
+    }
+    free(m->path);
+    m->path = NULL;
+    free(job.ok);
+    return ok;
+}
+
+/*
+ * Loads the categories that conffile lists from the directory prefix,
+ * reading their files as readmodel() does for src. When lazy, only the
+ * names and paths of their files, see loadfingerprint().
+ */
+static model_t *loadmodel(const char *conffile, const char *prefix,
+                          boole lazy, const source_t * src)
+{
+    model_t *m;
     char *finger_print_file_name;
     size_t finger_print_file_name_size;
     size_t prefix_size;
+    uint4 maxsize;
     char line[1024];
     FILE *fp;
 
@@ -162,110 +914,973 @@ extern void *special_textcat_Init(const char *conffile, const char *prefix)
         return NULL;
     }
 
-    h = (textcat_t *) malloc(sizeof(textcat_t));
-    h->size = 0;
-    h->maxsize = 16;
+    m = (model_t *) calloc(1, sizeof(model_t));
+    if (!m)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    maxsize = 16;
+    m->fprint = (void **)malloc(sizeof(void *) * maxsize);
+    m->path = (char **)malloc(sizeof(char *) * maxsize);
+    m->conffile = copystring(conffile);
+    m->prefix = copystring(prefix);
+    if (!m->fprint || !m->path || !m->conffile || !m->prefix)
+    {
+        fclose(fp);
+        freemodel(m);
+        return NULL;
+    }
+
+    prefix_size = strlen(prefix);
+    finger_print_file_name_size = prefix_size + 1;
+    finger_print_file_name =
+        (char *)malloc(sizeof(char) * (finger_print_file_name_size + 1024));
+    finger_print_file_name[0] = '\0';
+    strcat(finger_print_file_name, prefix);
+
+    while (wg_getline(line, 1024, fp))
+    {
+        char *p;
+        char *segment[4];
+
+        /*** Skip comments ***/
+        if ((p = strchr(line, '#')))
+        {
+            *p = '\0';
+        }
+
+        if (wg_split(segment, line, line, 4) < 2)
+        {
+            continue;
+        }
+
+        /*** Ensure enough space ***/
+        if (m->size == maxsize)
+        {
+            maxsize *= 2;
+            m->fprint = (void **)realloc(m->fprint, sizeof(void *) * maxsize);
+            m->path = (char **)realloc(m->path, sizeof(char *) * maxsize);
+        }
+
+        /*** Load data ***/
+        if ((m->fprint[m->size] = fp_Init(segment[1])) == NULL)
+        {
+            goto BAILOUT;
+        }
+
+        while (prefix_size + strlen(segment[0]) > finger_print_file_name_size)
+        {
+            char *tmp;
+            size_t tmp_size = finger_print_file_name_size * 2;
+            tmp =
+                (char *)realloc(finger_print_file_name,
+                                sizeof(char) * (tmp_size + 1));
+            if (tmp == NULL)
+            {
+                goto BAILOUT;
+            }
+            else
+            {
+                finger_print_file_name = tmp;
+                finger_print_file_name_size = tmp_size;
+            }
+        }
+        finger_print_file_name[prefix_size] = '\0';
+        strcat(finger_print_file_name, segment[0]);
+
+        m->path[m->size] = copystring(finger_print_file_name);
+        if (!m->path[m->size])
+        {
+            fp_Done(m->fprint[m->size]);
+            goto BAILOUT;
+        }
+        m->size++;
+    }
+
+    free(finger_print_file_name);
+
+    if (!lazy && !readmodel(m, src))
+    {
+        goto BAILOUT2;
+    }
+
+    if (lazy)
+    {
+        /*** Nothing to index yet: compare one by one ***/
+        m->state = (uint4 *) calloc(m->size + 1, sizeof(uint4));
+        if (!m->state)
+        {
+            goto BAILOUT2;
+        }
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_init(&m->lock, NULL);
+#endif
+    }
+    else
+    {
+        /*** Index all n-grams, so they can be scored in one go ***/
+        m->index = fpindex_Init(m->fprint, m->size);
+
+        /*** Otherwise, cluster them so that groups can be passed over ***/
+        if (!m->index)
+        {
+            m->tree = fptree_Init(m->fprint, m->size);
+        }
+    }
+
+    m->wins = (uint4 *) calloc(m->size + 1, sizeof(uint4));
+    if (!m->wins)
+    {
+        goto BAILOUT2;
+    }
+
+    fclose(fp);
+    return m;
+
+  BAILOUT:
+    free(finger_print_file_name);
+  BAILOUT2:
+    fclose(fp);
+    freemodel(m);
+    return NULL;
+}
+
+/*
+ * Makes a handle with default properties for s, and adds it to s. A new
+ * session takes the categories that from disabled.
+ */
+static textcat_t *addhandle(slot_t * s, const textcat_t * from)
+{
+    textcat_t *h = (textcat_t *) malloc(sizeof(textcat_t));
+    uint4 half, i;
+    model_t *m;
+
+    if (!h)
+    {
+        return NULL;
+    }
+    h->slot = s;
+    h->next = NULL;
+    h->fprint_disable[0] = NULL;
+    h->fprint_disable[1] = NULL;
+    h->active[0] = NULL;
+    h->active[1] = NULL;
     h->mindocsize = MINDOCSIZE;
-    h->fprint = (void **)malloc(sizeof(void *) * h->maxsize);
-    h->fprint_disable =
-        (unsigned char *)malloc(sizeof(unsigned char) * h->maxsize);
     /* added to store the state of languages */
     h->tmp_candidates = NULL;
+    h->tmp_context = NULL;
+    h->spare = NULL;
     h->utfaware = TC_TRUE;
+    h->adaptive = TC_FALSE;
+    h->beamwidth = 0;
+    h->threads = 1;
+    h->executor = NULL;
+    h->executordata = NULL;
+    h->pool = NULL;
+
+    LOCKSLOT(s);
+    half = s->generation & 1;
+    m = s->model[half];
+    h->fprint_disable[half] =
+        (unsigned char *)malloc(sizeof(unsigned char) * (m->size + 1));
+    if (h->fprint_disable[half])
+    {
+        for (i = 0; i < m->size; i++)
+        {
+            /* 0xF0 is the code for enabled languages, 0x0F for disabled */
+            h->fprint_disable[half][i] =
+                from ? from->fprint_disable[half][i] : 0xF0;
+        }
+        if (listactive(h, half, h->fprint_disable[half], m->size))
+        {
+            h->next = s->handles;
+            s->handles = h;
+        }
+    }
+    UNLOCKSLOT(s);
+
+    if (!h->active[half])
+    {
+        free(h->fprint_disable[half]);
+        free(h);
+        return NULL;
+    }
+    return h;
+}
+
+/* makes a handle with default properties for m, which it takes over */
+static textcat_t *newhandle(model_t * m)
+{
+    slot_t *s = (slot_t *) calloc(1, sizeof(slot_t));
+    textcat_t *h;
+
+    if (!s)
+    {
+        releasemodel(m);
+        return NULL;
+    }
+    s->model[0] = m;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_mutex_init(&s->reloadlock, NULL);
+#endif
+    s->names[0] = internnames(s, m, NULL, NULL, 0, &s->ids[0]);
+    h = s->names[0] ? addhandle(s, NULL) : NULL;
+    if (!h)
+    {
+        freeslot(s);
+        return NULL;
+    }
+    return h;
+}
+
+/*
+ * Loads the fingerprints that fpbundle_Write() put in the bundle src, and
+ * names the model bundlefile.
+ */
+static model_t *loadbundle(const char *bundlefile, const source_t * src)
+{
+    model_t *m = (model_t *) calloc(1, sizeof(model_t));
+    uint4 size;
+
+    if (!m)
+    {
+        return NULL;
+    }
+    m->conffile = copystring(bundlefile);
+    m->fixed = src->data || src->fd >= 0;
+    if (src->data)
+    {
+        m->bundle = fpbundle_Use(src->data, src->size, src->flags);
+    }
+    else if (src->fd >= 0)
+    {
+        m->bundle = fpbundle_OpenFd(src->fd, src->flags);
+    }
+    else
+    {
+        m->bundle = fpbundle_Open(bundlefile, src->flags);
+    }
+    if (!m->conffile || !m->bundle)
+    {
+        freemodel(m);
+        return NULL;
+    }
+    size = fpbundle_Size(m->bundle);
+    m->fprint = (void **)malloc(sizeof(void *) * (size + 1));
+    if (!m->fprint)
+    {
+        freemodel(m);
+        return NULL;
+    }
+    for (m->size = 0; m->size < size; m->size++)
+    {
+        m->fprint[m->size] = fpbundle_Fingerprint(m->bundle, m->size);
+        if (!m->fprint[m->size])
+        {
+            freemodel(m);
+            return NULL;
+        }
+    }
+
+    m->index = fpbundle_Index(m->bundle);
+    if (!m->index)
+    {
+        m->tree = fptree_Init(m->fprint, m->size);
+    }
+
+    m->wins = (uint4 *) calloc(m->size + 1, sizeof(uint4));
+    if (!m->wins)
+    {
+        freemodel(m);
+        return NULL;
+    }
+    return m;
+}
+
+/*
+ * Returns the model of conffile, prefix and lazy in the list that was
+ * loaded from the same version of conffile. The caller holds LOCKMODELS().
+ */
+static model_t *findmodel(const char *conffile, const char *prefix,
+                          boole lazy, const char *version)
+{
+    model_t *m;
+
+    for (m = models; m; m = m->next)
+    {
+        if (strcmp(m->conffile, conffile) == 0
+            && (m->prefix && prefix ? strcmp(m->prefix, prefix) == 0 :
+                m->prefix == prefix) && (m->state != NULL) == lazy
+            && strcmp(m->version, version) == 0)
+        {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the model loaded from conffile and prefix, lazily or not, or
+ * from the bundle src when prefix is NULL, loading it unless another
+ * handle did. A fresh model is always loaded anew, and from then on
+ * shared instead of the one loaded before. So is a model whose conffile
+ * (or bundle file) was replaced or written to since it was loaded; the
+ * fingerprint files that conffile lists are not looked at.
+ *
+ * Loading takes the lock only to look for the model and to add it to the
+ * list, so handles on other models never wait for it. Two handles that
+ * load the same model at once both read it, and the one that is later to
+ * add it frees its copy and shares the other.
+ */
+static model_t *sharemodel(const char *conffile, const char *prefix,
+                           boole lazy, const source_t * src, boole fresh)
+{
+    char version[128] = "";
+    model_t *m, *shared;
+
+    if (prefix || (!src->data && src->fd < 0))
+    {
+        /*** Stays empty where files cannot be told apart ***/
+        fpbundle_FileVersion(conffile, version, sizeof(version));
+    }
+
+    LOCKMODELS();
+    m = fresh ? NULL : findmodel(conffile, prefix, lazy, version);
+    if (m)
+    {
+        m->refs++;
+    }
+    UNLOCKMODELS();
+    if (m)
+    {
+        return m;
+    }
+
+    m = prefix ? loadmodel(conffile, prefix, lazy, src)
+        : loadbundle(conffile, src);
+    if (m && !(m->version = copystring(version)))
+    {
+        freemodel(m);
+        m = NULL;
+    }
+    if (!m)
+    {
+        return NULL;
+    }
+
+    LOCKMODELS();
+    shared = fresh ? NULL : findmodel(conffile, prefix, lazy, version);
+    if (shared)
+    {
+        shared->refs++;
+    }
+    else
+    {
+        m->refs = 1;
+        m->serial = ++lastserial;
+        m->next = models;
+        models = m;
+    }
+    UNLOCKMODELS();
+
+    if (shared)
+    {
+        freemodel(m);
+        m = shared;
+    }
+    return m;
+}
+
+/**
+ * Originaly this function had only one parameter (conffile) it has been modified since OOo use
+ * Basicaly prefix is the directory path where fingerprints are stored
+ */
+extern void *special_textcat_Init(const char *conffile, const char *prefix)
+{
+    model_t *m = sharemodel(conffile, prefix, 0, NULL, 0);
+
+    if (!m)
+    {
+        return NULL;
+    }
+    return newhandle(m);
+}
+
+extern void *textcat_InitThreads(const char *conffile, const char *prefix,
+                                 uint4 threads)
+{
+    source_t src = { NULL, 0, -1, 0, NULL, NULL };
+    pool_t *p = NULL;
+    model_t *m;
+    textcat_t *h;
+
+    if (threads < 1 || threads > MAXTHREADS)
+    {
+        return NULL;
+    }
+    if (threads > 1 && !(p = newpool(threads - 1)))
+    {
+        return NULL;
+    }
+    src.threads = p ? p->threads : NULL;
+    m = sharemodel(conffile, prefix, 0, &src, 0);
+    h = m ? newhandle(m) : NULL;
+    if (!h)
+    {
+        if (p)
+        {
+            wgthreadpool_Done(p->threads);
+            free(p);
+        }
+        return NULL;
+    }
+
+    /*** No one else has the handle yet, so its slot needs no lock ***/
+    h->threads = threads;
+    if (p)
+    {
+        p->refs++;
+        h->slot->pool = p;
+        h->pool = p;
+    }
+    return h;
+}
+
+extern void *textcat_InitLazy(const char *conffile, const char *prefix)
+{
+    model_t *m = sharemodel(conffile, prefix, 1, NULL, 0);
+
+    if (!m)
+    {
+        return NULL;
+    }
+    return newhandle(m);
+}
+
+/* reads the fingerprints of v named name, or all for NULL */
+static int preload(const view_t * v, const char *name)
+{
+    boole found = 0;
+    uint4 i;
+
+    for (i = 0; i < v->size; i++)
+    {
+        if (!name || strcmp(v->names[i], name) == 0)
+        {
+            if (!loadfingerprint(v->model, i))
+            {
+                return 0;
+            }
+            found = 1;
+        }
+    }
+    return found || !name;
+}
+
+extern int textcat_Preload(void *handle, const char *name)
+{
+    textcat_t *h = (textcat_t *) handle;
+    view_t v;
+    uint4 half = enter(h, &v);
+    int result = preload(&v, name);
+
+    leave(h, half);
+    return result;
+}
+
+extern void *textcat_InitBundle(const char *bundlefile)
+{
+    source_t src = { NULL, 0, -1, 0, NULL, NULL };
+    model_t *m = sharemodel(bundlefile, NULL, 0, &src, 0);
+
+    if (!m)
+    {
+        return NULL;
+    }
+    return newhandle(m);
+}
+
+extern int textcat_WriteBundle(void *handle, const char *bundlefile)
+{
+    textcat_t *h = (textcat_t *) handle;
+    view_t v;
+    uint4 half = enter(h, &v);
+    int result = preload(&v, NULL)
+        && fpbundle_Write(bundlefile, v.fprint, v.size, v.index);
+
+    leave(h, half);
+    return result;
+}
+
+extern void *textcat_InitBundleFd(int fd, int flags)
+{
+    source_t src = { NULL, 0, -1, 0, NULL, NULL };
+    char id[128];
+    model_t *m;
+
+    /*** Name the model after the object, whatever descriptor it has ***/
+    if (!fpbundle_FileId(fd, id, sizeof(id)))
+    {
+        return NULL;
+    }
+    src.fd = fd;
+    src.flags = flags;
+    m = sharemodel(id, NULL, 0, &src, 0);
+    if (!m)
+    {
+        return NULL;
+    }
+    return newhandle(m);
+}
+
+extern int textcat_WriteBundleFd(void *handle, int fd)
+{
+    textcat_t *h = (textcat_t *) handle;
+    view_t v;
+    uint4 half = enter(h, &v);
+    int result = preload(&v, NULL)
+        && fpbundle_WriteFd(fd, v.fprint, v.size, v.index);
+
+    leave(h, half);
+    return result;
+}
+
+extern void *textcat_InitBundleMemory(const void *data, size_t size,
+                                      int flags)
+{
+    source_t src = { NULL, 0, -1, 0, NULL, NULL };
+    char id[64];
+    model_t *m;
+
+    sprintf(id, "<memory %p>", data);
+    src.data = data;
+    src.size = size;
+    src.flags = flags;
+    m = sharemodel(id, NULL, 0, &src, 0);
+    if (!m)
+    {
+        return NULL;
+    }
+    return newhandle(m);
+}
+
+extern void *textcat_NewSession(void *handle)
+{
+    textcat_t *h = (textcat_t *) handle;
+    textcat_t *s = addhandle(h->slot, h);
+
+    if (!s)
+    {
+        return NULL;
+    }
+    s->mindocsize = h->mindocsize;
+    s->utfaware = h->utfaware;
+    s->adaptive = h->adaptive;
+    s->beamwidth = h->beamwidth;
+    s->executor = h->executor;
+    s->executordata = h->executordata;
+    textcat_SetProperty(s, TCPROP_THREADS, h->threads);
+    return s;
+}
+
+/*
+ * Loads the model of h anew and puts it in the other half of the slot,
+ * with what every handle keeps for it, before moving on to the next
+ * generation. The old half is freed once the classifications that still
+ * use it are done.
+ */
+extern int textcat_Reload(void *handle)
+{
+    textcat_t *h = (textcat_t *) handle;
+    slot_t *s = h->slot;
+    source_t src = { NULL, 0, -1, 0, NULL, NULL };
+    char *conffile, *prefix = NULL;
+    boole lazy, ok;
+    uint4 half, next;
+    model_t *m, *old;
+    textcat_t *t;
+
+    /*** Only reloads change the model, and they hold LOCKSLOT() then ***/
+    LOCKSLOT(s);
+    old = s->model[s->generation & 1];
+    conffile = copystring(old->conffile);
+    if (old->prefix)
+    {
+        prefix = copystring(old->prefix);
+    }
+    lazy = old->state != NULL;
+    ok = !old->fixed && conffile && (prefix || !old->prefix);
+    UNLOCKSLOT(s);
+    src.reader = h;
+
+    m = ok ? sharemodel(conffile, prefix, lazy, &src, 1) : NULL;
+    free(conffile);
+    free(prefix);
+    if (!m)
+    {
+        return 0;
+    }
+
+    /*** Only one reload at a time moves on to the next generation ***/
+    LOCKRELOAD(s);
+    half = s->generation & 1;
+    next = half ^ 1;
+
+    /*** The last reload waited for this half, but look again ***/
+    waitreaders(s, next);
+
+    LOCKSLOT(s);
+    old = s->model[half];
+    s->model[next] = m;
+    s->names[next] = internnames(s, m, s->names[half], s->ids[half],
+                                 old->size, &s->ids[next]);
+    for (t = s->handles; t && s->names[next]; t = t->next)
+    {
+        t->fprint_disable[next] =
+            carrydisable(t->fprint_disable[half], s->names[half], old->size,
+                         s->names[next], m->size);
+        if (!t->fprint_disable[next]
+            || !listactive(t, next, t->fprint_disable[next], m->size))
+        {
+            break;
+        }
+    }
+    if (!s->names[next] || t)
+    {
+        for (t = s->handles; t; t = t->next)
+        {
+            free(t->fprint_disable[next]);
+            t->fprint_disable[next] = NULL;
+            free(t->active[next]);
+            t->active[next] = NULL;
+        }
+        free((void *)s->names[next]);
+        s->names[next] = NULL;
+        free(s->ids[next]);
+        s->ids[next] = NULL;
+        s->model[next] = NULL;
+        UNLOCKSLOT(s);
+        UNLOCKRELOAD(s);
+        releasemodel(m);
+        return 0;
+    }
+    WGATOMICSYNCSET(&s->generation, s->generation + 1);
+    UNLOCKSLOT(s);
+
+    /*** New classifications take the new half; let the old ones end ***/
+    waitreaders(s, half);
+
+    LOCKSLOT(s);
+    for (t = s->handles; t; t = t->next)
+    {
+        free(t->fprint_disable[half]);
+        t->fprint_disable[half] = NULL;
+        free(t->active[half]);
+        t->active[half] = NULL;
+    }
+    free((void *)s->names[half]);
+    s->names[half] = NULL;
+    free(s->ids[half]);
+    s->ids[half] = NULL;
+    s->model[half] = NULL;
+    UNLOCKSLOT(s);
+    UNLOCKRELOAD(s);
+
+    releasemodel(old);
+    return 1;
+}
+
+/*
+ * Tells whether the category category goes by name: either its name, or
+ * the language tag that it starts with, as in "de" for "de--utf8".
+ */
+static boole matchname(const char *category, const char *name)
+{
+    size_t len;
+
+    if (!name)
+    {
+        return 1;
+    }
+    len = strlen(name);
+    return strncmp(category, name, len) == 0
+        && (category[len] == '\0' || category[len] == '-');
+}
+
+extern int textcat_SetEnabled(void *handle, const char *name, int enabled)
+{
+    textcat_t *h = (textcat_t *) handle;
+    slot_t *s = h->slot;
+    uint4 half, i;
+    model_t *m;
+    int found = 0;
+
+    /*** Reloads switch halves under the lock, so this one stays current ***/
+    LOCKSLOT(s);
+    half = s->generation & 1;
+    m = s->model[half];
+    for (i = 0; i < m->size; i++)
+    {
+        if (matchname(s->names[half][i], name))
+        {
+            h->fprint_disable[half][i] = enabled ? 0xF0 : 0x0F;
+            found++;
+        }
+    }
+    if (found && !listactive(h, half, h->fprint_disable[half], m->size))
+    {
+        found = -1;
+    }
+    UNLOCKSLOT(s);
+    return found;
+}
+
+extern void *textcat_GetMask(void *handle, const char *const *names)
+{
+    textcat_t *h = (textcat_t *) handle;
+    slot_t *s = h->slot;
+    mask_t *mask;
+    uint4 i, k;
+
+    LOCKSLOT(s);
+    mask = (mask_t *) malloc(sizeof(mask_t) + s->ninterned + 1);
+    if (mask)
+    {
+        mask->slot = s;
+        mask->size = s->ninterned;
+        mask->allow = (uchar *) (mask + 1);
+        for (k = 0; k < s->ninterned; k++)
+        {
+            mask->allow[k] = 0;
+            for (i = 0; names && names[i]; i++)
+            {
+                if (matchname(s->interned[k], names[i]))
+                {
+                    mask->allow[k] = 1;
+                    break;
+                }
+            }
+        }
+    }
+    UNLOCKSLOT(s);
+    return mask;
+}
+
+extern void textcat_ReleaseMask(void *handle, void *mask)
+{
+    (void)handle;
+    free(mask);
+}
+
+extern candidate_t *textcat_GetClassifyFullOutput(void *handle)
+{
+    /*** Classifications keep their scores in their context ***/
+    (void)handle;
+    return (candidate_t *) malloc(sizeof(candidate_t)
+                                  * TEXTCAT_MAXCANDIDATES);
+}
+
+extern void textcat_ReleaseClassifyFullOutput(void *handle,
+                                              candidate_t * candidates)
+{
+    (void)handle;
+    if (candidates != NULL)
+    {
+        free(candidates);
+    }
+}
 
-    prefix_size = strlen(prefix);
-    finger_print_file_name_size = prefix_size + 1;
-    finger_print_file_name =
-        (char *)malloc(sizeof(char) * (finger_print_file_name_size + 1024));
-    finger_print_file_name[0] = '\0';
-    strcat(finger_print_file_name, prefix);
+/*
+ * Looks up the categories that won most often, so that c compares them
+ * first. The counts keep changing under other threads; any snapshot of
+ * them is as good as another, since the order does not change results.
+ */
+static void findfirst(textcat_t * h, const view_t * v, textcat_context_t * c)
+{
+    uint4 count[ADAPTIVEFIRST];
+    uint4 i, k;
 
-    while (wg_getline(line, 1024, fp))
+    c->nfirst = 0;
+    c->calls = 0;
+    if (!h->adaptive)
     {
-        char *p;
-        char *segment[4];
+        return;
+    }
+    for (i = 0; i < v->size; i++)
+    {
+        uint4 wins = WGATOMICGET(&v->wins[i]);
 
-        /*** Skip comments ***/
-        if ((p = strchr(line, '#')))
+        if (wins == 0
+            || (c->nfirst == ADAPTIVEFIRST && wins <= count[c->nfirst - 1]))
         {
-            *p = '\0';
+            continue;
         }
-
-        if (wg_split(segment, line, line, 4) < 2)
+        if (c->nfirst < ADAPTIVEFIRST)
         {
-            continue;
+            c->nfirst++;
         }
-
-        /*** Ensure enough space ***/
-        if (h->size == h->maxsize)
+        for (k = c->nfirst - 1; k > 0 && wins > count[k - 1]; k--)
         {
-            h->maxsize *= 2;
-            h->fprint =
-                (void **)realloc(h->fprint, sizeof(void *) * h->maxsize);
-            h->fprint_disable =
-                (unsigned char *)realloc(h->fprint_disable,
-                                         sizeof(unsigned char) * h->maxsize);
+            c->first[k] = c->first[k - 1];
+            count[k] = count[k - 1];
         }
+        c->first[k] = i;
+        count[k] = wins;
+    }
+}
 
-        /*** Load data ***/
-        if ((h->fprint[h->size] = fp_Init(segment[1])) == NULL)
+/*
+ * A part of the comparisons of textcat_ClassifyFullWithContext(). The
+ * threshold that the parts share only ever drops, and every category that
+ * ends up below the final threshold has been compared with a threshold at
+ * least as high, so it gets its exact score whatever the timing. The
+ * outcome is therefore the same as comparing on one thread.
+ */
+static void scorepart(void *arg, uint4 part)
+{
+    job_t *job = (job_t *) arg;
+    const view_t *v = job->v;
+    textcat_context_t *c = job->c;
+    uint4 k, scored = 0;
+
+    for (k = part; k < job->nbound; k += job->nparts)
+    {
+        int minscore = WGATOMICGET(&job->minscore);
+        int threshold = MAXSCORE;
+        uint4 i = c->bound[k].i;
+        int score;
+
+        if (minscore != MAXSCORE)
         {
-            goto BAILOUT;
+            threshold = (int)((double)minscore * THRESHOLDVALUE);
         }
-
-        while (prefix_size + strlen(segment[0]) > finger_print_file_name_size)
+        if (c->bound[k].bound >= threshold)
         {
-            char *tmp;
-            size_t tmp_size = finger_print_file_name_size * 2;
-            tmp =
-                (char *)realloc(finger_print_file_name,
-                                sizeof(char) * (tmp_size + 1));
-            if (tmp == NULL)
-            {
-                goto BAILOUT;
-            }
-            else
+            if (c->bound[k].first < ADAPTIVEFIRST)
             {
-                finger_print_file_name = tmp;
-                finger_print_file_name_size = tmp_size;
+                continue;
             }
+            break;
         }
-        finger_print_file_name[prefix_size] = '\0';
-        strcat(finger_print_file_name, segment[0]);
 
-        if (fp_Read(h->fprint[h->size], finger_print_file_name, 400) == 0)
-            goto BAILOUT;
-        h->fprint_disable[h->size] = 0xF0;  /* 0xF0 is the code for enabled
-                                               languages, 0x0F is for disabled 
-                                             */
-        h->size++;
+        score = fp_Compare(v->fprint[i], c->unknown, threshold);
+        scored++;
+        c->scores[i] = score;
+        while (score < minscore
+               && !WGATOMICCAS(&job->minscore, minscore, score))
+        {
+            minscore = WGATOMICGET(&job->minscore);
+        }
     }
+    WGATOMICADD(&job->scored, scored);
+}
 
-    free(finger_print_file_name);
+/*
+ * Sizes the memory of c for the model of v, unless it is already. A
+ * reload can change the model from one classification to the next.
+ */
+static boole fitcontext(textcat_t * h, const view_t * v,
+                        textcat_context_t * c)
+{
+    if (c->serial == v->model->serial)
+    {
+        return 1;
+    }
+    free(c->scores);
+    free(c->acc);
+    free(c->done);
+    free(c->work);
+    free(c->bound);
+    free(c->active);
+    c->scores = NULL;
+    c->acc = NULL;
+    c->done = NULL;
+    c->work = NULL;
+    c->serial = 0;
 
-    fclose(fp);
-    return h;
+    c->scores = (sint4 *) malloc(sizeof(sint4) * (v->size + 1));
+    c->bound = (bound_t *) malloc(sizeof(bound_t) * (v->size + 1));
+    c->active = (uint4 *) malloc(sizeof(uint4) * (v->size + 1));
+    if (!c->scores || !c->bound || !c->active)
+    {
+        return 0;
+    }
+    if (v->index)
+    {
+        c->acc = (uint2 *) malloc(sizeof(uint2) *
+                                  (fpindex_AccSize(v->index) + 1));
+        if (!c->acc)
+        {
+            return 0;
+        }
+    }
+    else if (v->tree)
+    {
+        c->done = (uchar *) malloc(sizeof(uchar) * (v->size + 1));
+        c->work = (uint4 *) malloc(sizeof(uint4) *
+                                   (fptree_WorkSize(v->tree) + 1));
+        if (!c->done || !c->work)
+        {
+            return 0;
+        }
+    }
+    findfirst(h, v, c);
+    c->serial = v->model->serial;
+    return 1;
+}
 
-  BAILOUT:
-    free(finger_print_file_name);
-    fclose(fp);
-    textcat_Done(h);
-    return NULL;
+/* makes a context for classifying with the model of v */
+static textcat_context_t *newcontext(textcat_t * h, const view_t * v)
+{
+    textcat_context_t *c =
+        (textcat_context_t *) calloc(1, sizeof(textcat_context_t));
+
+    if (!c)
+    {
+        return NULL;
+    }
+    c->unknown = fp_Init(NULL);
+    if (!c->unknown || !fp_KeepBuffers(c->unknown) || !fitcontext(h, v, c))
+    {
+        textcat_ReleaseContext(h, c);
+        return NULL;
+    }
+    return c;
 }
 
-extern candidate_t *textcat_GetClassifyFullOutput(void *handle)
+extern void *textcat_GetContext(void *handle)
 {
     textcat_t *h = (textcat_t *) handle;
-    return (candidate_t *) malloc(sizeof(candidate_t) * h->size);
+    view_t v;
+    uint4 half = enter(h, &v);
+    textcat_context_t *c = newcontext(h, &v);
+
+    leave(h, half);
+    return c;
 }
 
-extern void textcat_ReleaseClassifyFullOutput(void *handle,
-                                              candidate_t * candidates)
+extern void textcat_ReleaseContext(void *handle, void *context)
 {
-    if (candidates != NULL)
+    textcat_context_t *c = (textcat_context_t *) context;
+
+    (void)handle;
+    if (c == NULL)
     {
-        free(candidates);
+        return;
     }
+    if (c->unknown)
+    {
+        fp_Done(c->unknown);
+    }
+    free(c->scores);
+    free(c->acc);
+    free(c->done);
+    free(c->work);
+    free(c->bound);
+    free(c->active);
+    free(c);
 }
 
 extern char *textcat_Classify(void *handle, const char *buffer, size_t size)
@@ -278,8 +1893,20 @@ extern char *textcat_Classify(void *handle, const char *buffer, size_t size)
     {
         h->tmp_candidates = textcat_GetClassifyFullOutput(h);
     }
+    if (h->tmp_context == NULL)
+    {
+        h->tmp_context = textcat_GetContext(h);
+    }
 
-    cnt = textcat_ClassifyFull(h, buffer, size, h->tmp_candidates);
+    if (h->tmp_context)
+    {
+        cnt = textcat_ClassifyFullWithContext(h, h->tmp_context, buffer,
+                                              size, h->tmp_candidates);
+    }
+    else
+    {
+        cnt = textcat_ClassifyFull(h, buffer, size, h->tmp_candidates);
+    }
 
     switch (cnt)
     {
@@ -312,72 +1939,484 @@ extern int textcat_ClassifyFull(void *handle, const char *buffer, size_t size,
                                 candidate_t * candidates)
 {
     textcat_t *h = (textcat_t *) handle;
-    uint4 i, cnt = 0;
+    void *context, *spare;
+    int result;
+
+    /*** The spare context, or one of our own while another thread has it ***/
+    WGATOMICEXCHANGE(&h->spare, NULL, context);
+    if (!context && !(context = textcat_GetContext(handle)))
+    {
+        return TEXTCAT_RESULT_UNKNOWN;
+    }
+    result = textcat_ClassifyFullWithContext(handle, context, buffer, size,
+                                             candidates);
+
+    /*** Kept for the next call, rather than one put back meanwhile ***/
+    WGATOMICEXCHANGE(&h->spare, context, spare);
+    textcat_ReleaseContext(handle, spare);
+    return result;
+}
+
+/*
+ * Classifies buffer with context c, comparing categories one by one on
+ * up to threads threads. A bounded buffer ends after size bytes, zero
+ * byte or not, see fp_CreateSpan().
+ */
+static int classify(textcat_t * h, const view_t * v, textcat_context_t * c,
+                    const mask_t * mask, const char *buffer, size_t size,
+                    boole bounded, candidate_t * candidates, uint4 threads)
+{
+    uint4 i, j, best = 0, cnt = 0;
     int minscore = MAXSCORE;
     int threshold = minscore;
+    const uint4 *active = v->active;
+    uint4 nactive = v->nactive;
+
+    void *unknown = c->unknown;
 
-    void *unknown;
+    /*** Only the categories that handle and mask both allow take part ***/
+    if (mask)
+    {
+        for (j = 0, nactive = 0; j < v->nactive; j++)
+        {
+            uint4 id = v->ids[v->active[j]];
+
+            if (id < mask->size && mask->allow[id])
+            {
+                c->active[nactive++] = v->active[j];
+            }
+        }
+        active = c->active;
+    }
+
+    if (h->adaptive && ++c->calls >= ADAPTIVEINTERVAL)
+    {
+        findfirst(h, v, c);
+    }
 
-    unknown = fp_Init(NULL);
     fp_SetProperty(unknown, TCPROP_UTF8AWARE, h->utfaware);
     fp_SetProperty(unknown, TCPROP_MINIMUM_DOCUMENT_SIZE, h->mindocsize);
-    if (fp_Create(unknown, buffer, size, MAXNGRAMS) == 0)
+    c->scored = 0;
+    if ((bounded ? fp_CreateSpan(unknown, buffer, size, MAXNGRAMS)
+         : fp_Create(unknown, buffer, size, MAXNGRAMS)) == 0)
     {
         /*** Too little information ***/
-        fp_Done(unknown);
         return TEXTCAT_RESULT_SHORT;
     }
 
     /*** Calculate the score for each category. ***/
-    for (i = 0; i < h->size; i++)
+    if (v->index && fpindex_Score(v->index, unknown, c->scores, c->acc))
     {
-        int score;
-        if (h->fprint_disable[i] & 0x0F)
-        {                       /* if this language is disabled */
-            score = MAXSCORE;
+        c->scored = nactive;
+        for (j = 0; j < nactive; j++)
+        {
+            /*** Same cutoff as fp_Compare() ***/
+            int score;
+
+            i = active[j];
+            score = c->scores[i] > threshold ? MAXSCORE : c->scores[i];
+            c->scores[i] = score;
+            if (score < minscore)
+            {
+                minscore = score;
+                threshold = (int)((double)score * THRESHOLDVALUE);
+                best = i;
+            }
         }
-        else
+    }
+    else if (v->tree && threads <= 1)
+    {
+        /**
+         * Score the frequent winners, if any, and then go down the tree
+         * for the categories that can still be candidates.
+         */
+        uint4 k;
+
+        for (i = 0; i < v->size; i++)
+        {
+            c->scores[i] = MAXSCORE;
+            c->done[i] = FPTREE_SKIP;
+        }
+        for (j = 0; j < nactive; j++)
+        {
+            c->done[active[j]] = FPTREE_TODO;
+        }
+        for (k = 0; k < c->nfirst; k++)
+        {
+            i = c->first[k];
+            if (c->done[i] == FPTREE_TODO)
+            {
+                c->scores[i] = fp_Compare(v->fprint[i], unknown, threshold);
+                c->done[i] = FPTREE_SCORED;
+                c->scored++;
+                if (c->scores[i] < minscore)
+                {
+                    minscore = c->scores[i];
+                    threshold = (int)((double)minscore * THRESHOLDVALUE);
+                }
+            }
+        }
+        c->scored += fptree_Search(v->tree, unknown, h->beamwidth, c->done,
+                                   c->scores, &minscore, c->work);
+        if (minscore != MAXSCORE)
+        {
+            threshold = (int)((double)minscore * THRESHOLDVALUE);
+        }
+
+        for (j = 0; j < nactive; j++)
+        {
+            i = active[j];
+            if (c->scores[i] == minscore && c->scores[best] != minscore)
+            {
+                best = i;
+            }
+        }
+    }
+    else
+    {
+        /**
+         * Compare the categories one by one, the most promising first, so
+         * that the threshold drops quickly: the frequent winners, if any,
+         * then the others by lower bound. Which categories end up below
+         * the final threshold does not depend on the order. Once the lower
+         * bound of a category exceeds the threshold, it cannot be a
+         * candidate, and neither can any of the categories after it.
+         */
+        uint4 k;
+
+        for (j = 0; j < nactive; j++)
+        {
+            i = active[j];
+            c->bound[j].first = ADAPTIVEFIRST;
+            for (k = 0; k < c->nfirst; k++)
+            {
+                if (c->first[k] == i)
+                {
+                    c->bound[j].first = k;
+                }
+            }
+            c->bound[j].i = i;
+            c->bound[j].bound = !loadfingerprint(v->model, i) ? MAXSCORE :
+                fp_Bound(v->fprint[i], unknown);
+            c->scores[i] = MAXSCORE;
+        }
+        qsort(c->bound, nactive, sizeof(bound_t), cmpbounds);
+
+        if (threads > 1)
         {
-            score = fp_Compare(h->fprint[i], unknown, threshold);
-            /* printf("Score for %s : %i\n", fp_Name(h->fprint[i]), score); */
+            job_t job;
+
+            job.h = h;
+            job.v = v;
+            job.c = c;
+            job.nbound = nactive;
+            job.nparts = WGMAX(WGMIN(threads, nactive), 1);
+            job.minscore = MAXSCORE;
+            job.scored = 0;
+            if (h->executor)
+            {
+                h->executor(h->executordata, scorepart, &job, job.nparts);
+            }
+            else
+            {
+                wgthreadpool_Run(h->pool ? h->pool->threads : NULL,
+                                 scorepart, &job, job.nparts);
+            }
+
+            c->scored = job.scored;
+            minscore = job.minscore;
+            if (minscore != MAXSCORE)
+            {
+                threshold = (int)((double)minscore * THRESHOLDVALUE);
+            }
+            for (j = 0; j < nactive; j++)
+            {
+                if (c->scores[active[j]] == minscore)
+                {
+                    best = active[j];
+                    break;
+                }
+            }
         }
-        candidates[i].score = score;
-        candidates[i].name = fp_Name(h->fprint[i]);
-        if (score < minscore)
+        else
         {
-            minscore = score;
-            threshold = (int)((double)score * THRESHOLDVALUE);
+            for (k = 0; k < nactive; k++)
+            {
+                int score;
+
+                if (c->bound[k].bound >= threshold)
+                {
+                    if (c->bound[k].first < ADAPTIVEFIRST)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+
+                i = c->bound[k].i;
+                score = fp_Compare(v->fprint[i], unknown, threshold);
+                /* printf("Score for %s : %i\n", fp_Name(v->fprint[i]),
+                   score); */
+                c->scored++;
+                c->scores[i] = score;
+                if (score < minscore)
+                {
+                    minscore = score;
+                    threshold = (int)((double)score * THRESHOLDVALUE);
+                    best = i;
+                }
+            }
         }
     }
 
     /*** Find the best performers ***/
-    for (i = 0, cnt = 0; i < h->size; i++)
+    for (j = 0, cnt = 0; j < nactive; j++)
     {
-        if (candidates[i].score < threshold)
+        i = active[j];
+        if (c->scores[i] < threshold)
         {
-            if (++cnt == MAXCANDIDATES + 1)
+            if (++cnt == TEXTCAT_MAXCANDIDATES + 1)
             {
                 break;
             }
 
-            memcpy(&candidates[cnt - 1], &candidates[i], sizeof(candidate_t));
-
+            candidates[cnt - 1].score = c->scores[i];
+            candidates[cnt - 1].name = v->names[i];
         }
     }
 
-    fp_Done(unknown);
     /*** The verdict ***/
-    if (cnt == MAXCANDIDATES + 1)
+    if (cnt == TEXTCAT_MAXCANDIDATES + 1)
     {
         return TEXTCAT_RESULT_UNKNOWN;
     }
     else
     {
+        if (h->adaptive && cnt > 0)
+        {
+            WGATOMICINC(&v->wins[best]);
+        }
         qsort(candidates, cnt, sizeof(candidate_t), cmpcandidates);
         return cnt;
     }
 }
 
+extern int textcat_ClassifyFullWithContext(void *handle, void *context,
+                                           const char *buffer, size_t size,
+                                           candidate_t * candidates)
+{
+    textcat_t *h = (textcat_t *) handle;
+    textcat_context_t *c = (textcat_context_t *) context;
+    view_t v;
+    uint4 half = enter(h, &v);
+    int result = TEXTCAT_RESULT_UNKNOWN;
+
+    if (fitcontext(h, &v, c))
+    {
+        result = classify(h, &v, c, NULL, buffer, size, 0, candidates,
+                          h->threads);
+    }
+    leave(h, half);
+    return result;
+}
+
+extern int textcat_ClassifyFullWithMask(void *handle, void *context,
+                                        const void *mask, const char *buffer,
+                                        size_t size, candidate_t * candidates)
+{
+    textcat_t *h = (textcat_t *) handle;
+    textcat_context_t *c = (textcat_context_t *) context;
+    const mask_t *m = (const mask_t *)mask;
+    view_t v;
+    uint4 half;
+    int result = TEXTCAT_RESULT_UNKNOWN;
+
+    if (m && m->slot != h->slot)
+    {
+        return result;
+    }
+    half = enter(h, &v);
+    if (fitcontext(h, &v, c))
+    {
+        result = classify(h, &v, c, m, buffer, size, 0, candidates,
+                          h->threads);
+    }
+    leave(h, half);
+    return result;
+}
+
+/*
+ * A batch of documents, either spans or a packed buffer with offsets.
+ * Every part takes the next document that nobody has taken yet, so that
+ * long and short documents balance out.
+ */
+typedef struct
+{
+    textcat_t *h;
+    view_t v;                   /* the whole batch uses the same model */
+    const textcat_span_t *spans;
+    const char *buffer;
+    const size_t *offsets;
+    uint4 count;
+    candidate_t *candidates;
+    int *results;
+    uint4 next;                 /* next document to classify */
+    uint4 failed;               /* parts that could not get going */
+} batch_t;
+
+/*
+ * A part of a batch. Which part it is does not matter, see batch_t, nor
+ * which thread runs it: a busy pool runs all parts on the caller.
+ */
+static void classifypart(void *arg, uint4 part)
+{
+    batch_t *b = (batch_t *) arg;
+    textcat_t *h = b->h;
+    textcat_context_t *context = newcontext(h, &b->v);
+    candidate_t *tmp = textcat_GetClassifyFullOutput(h);
+
+    (void)part;
+    while (context && tmp)
+    {
+        uint4 d = WGATOMICADD(&b->next, 1);
+        const char *buffer;
+        size_t size;
+        int result;
+
+        if (d >= b->count)
+        {
+            break;
+        }
+        if (b->spans)
+        {
+            buffer = b->spans[d].buffer;
+            size = b->spans[d].size;
+        }
+        else
+        {
+            buffer = b->buffer + b->offsets[d];
+            size = b->offsets[d + 1] - b->offsets[d];
+        }
+
+        /**
+         * Documents need not end in a zero byte, and one must not run on
+         * into the next, so each is read no further than its size. The
+         * batch is what runs in parallel, not the comparisons.
+         */
+        result = classify(h, &b->v, context, NULL, buffer, size, 1, tmp, 1);
+        b->results[d] = result;
+        if (result > 0)
+        {
+            memcpy(&b->candidates[d * TEXTCAT_MAXCANDIDATES], tmp,
+                   sizeof(candidate_t) * result);
+        }
+    }
+
+    if (!context || !tmp)
+    {
+        WGATOMICINC(&b->failed);
+    }
+    textcat_ReleaseClassifyFullOutput(h, tmp);
+    textcat_ReleaseContext(h, context);
+}
+
+static int classifybatch(batch_t * b)
+{
+    textcat_t *h = b->h;
+    uint4 nparts = WGMAX(WGMIN(h->threads, b->count), 1);
+    uint4 half, i;
+
+    for (i = 0; i < b->count; i++)
+    {
+        b->results[i] = TEXTCAT_RESULT_UNKNOWN;
+    }
+    b->next = 0;
+    b->failed = 0;
+
+    half = enter(h, &b->v);
+
+    if (nparts == 1)
+    {
+        classifypart(b, 0);
+    }
+    else if (h->executor)
+    {
+        h->executor(h->executordata, classifypart, b, nparts);
+    }
+    else
+    {
+        wgthreadpool_Run(h->pool ? h->pool->threads : NULL, classifypart, b,
+                         nparts);
+    }
+    leave(h, half);
+
+    return b->failed < nparts;
+}
+
+extern int textcat_ClassifyBatch(void *handle, const textcat_span_t * spans,
+                                 uint4 count, candidate_t * candidates,
+                                 int *results)
+{
+    batch_t b;
+
+    b.h = (textcat_t *) handle;
+    b.spans = spans;
+    b.buffer = NULL;
+    b.offsets = NULL;
+    b.count = count;
+    b.candidates = candidates;
+    b.results = results;
+    return classifybatch(&b);
+}
+
+extern int textcat_ClassifyPacked(void *handle, const char *buffer,
+                                  const size_t *offsets, uint4 count,
+                                  candidate_t * candidates, int *results)
+{
+    batch_t b;
+
+    b.h = (textcat_t *) handle;
+    b.spans = NULL;
+    b.buffer = buffer;
+    b.offsets = offsets;
+    b.count = count;
+    b.candidates = candidates;
+    b.results = results;
+    return classifybatch(&b);
+}
+
+extern uint4 textcat_GetScoredCount(void *handle, void *context)
+{
+    textcat_context_t *c = (textcat_context_t *) context;
+
+    (void)handle;
+    return c->scored;
+}
+
+extern const char *textcat_ClassifyScript(void *handle, const char *buffer,
+                                          size_t size)
+{
+    uint4 counts[NSCRIPTS];
+    uint4 i, best = SCRIPT_COMMON, most = 0;
+
+    (void)handle;
+    memset(counts, 0, sizeof(counts));
+    script_Count(buffer, size, counts);
+    for (i = SCRIPT_COMMON + 1; i < NSCRIPTS; i++)
+    {
+        if (counts[i] > most)
+        {
+            best = i;
+            most = counts[i];
+        }
+    }
+    if (best == SCRIPT_COMMON)
+    {
+        return TEXTCAT_RESULT_SHORT_STR;
+    }
+    return script_Name((script_t) best);
+}
+
 extern const char *textcat_Version(void)
 {
     return EXTTEXTCAT_VERSION;
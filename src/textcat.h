@@ -45,6 +45,15 @@
 #define TEXTCAT_RESULT_UNKNOWN        0
 #define TEXTCAT_RESULT_SHORT         -2
 
+/* The most candidates a classification gives; more is unknown */
+#define TEXTCAT_MAXCANDIDATES         5
+
+/* Flags for textcat_InitBundleFd() */
+#define TCBUNDLE_WILLNEED             1 /* read the whole bundle in now */
+#define TCBUNDLE_LOCK                 2 /* keep it in memory */
+#define TCBUNDLE_HUGEPAGES            4 /* map it with huge pages */
+#define TCBUNDLE_TRUSTED              8 /* skip the checksum */
+
 /* Old deprecated bad spelling. */
 #define _TEXTCAT_RESULT_UNKOWN       TEXTCAT_RESULT_UNKNOWN_STR
 #define _TEXTCAT_RESULT_SHORT        TEXTCAT_RESULT_SHORT_STR
@@ -61,6 +70,29 @@ extern "C"
         const char *name;
     } candidate_t;
 
+    /**
+     * textcat_span_t - A document in a batch: size bytes at buffer.
+     */
+    typedef struct
+    {
+        const char *buffer;
+        size_t size;
+    } textcat_span_t;
+
+    /**
+     * textcat_Task - One part of the work of a classification, see
+     * textcat_Executor.
+     */
+    typedef void (*textcat_Task) (void *arg, uint4 part);
+
+    /**
+     * textcat_Executor - Runs task(arg, part) for every part from 0 to
+     * nparts - 1, in any order and on any threads, and returns once all of
+     * them have returned. data is what was passed to textcat_SetExecutor().
+     */
+    typedef void (*textcat_Executor) (void *data, textcat_Task task,
+                                      void *arg, uint4 nparts);
+
     /**
      * textcat_Init() - Initialize the text classifier. The textfile
      * conffile should contain a list of fingerprint filenames and
@@ -88,13 +120,204 @@ extern "C"
      * Returns: handle on success, NULL on error. (At the moment, the
      * only way errors can occur, is when the library cannot read the
      * conffile, or one of the fingerprint files listed in it.)
+     *
+     * The fingerprints are loaded once per process: handles initialized
+     * with the same conffile and prefix share them, until the last of
+     * those handles is freed. Once conffile is replaced or written to,
+     * handles initialized after that load it anew. Fingerprint files that
+     * change while conffile does not are only read again by
+     * textcat_Reload().
      */
     extern void *special_textcat_Init(const char *conffile,
                                       const char *prefix);
 
+    /**
+     * textcat_InitThreads() - Same as special_textcat_Init(), but reads
+     * the fingerprint files on up to threads threads, which the handle
+     * keeps afterwards as if TCPROP_THREADS had been set to threads. The
+     * fingerprints are the same as when read on one thread.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *textcat_InitThreads(const char *conffile,
+                                     const char *prefix, uint4 threads);
+
+    /**
+     * textcat_InitLazy() - Same as special_textcat_Init(), but only reads
+     * conffile: each fingerprint is read when it is first compared with,
+     * by whichever thread does so first, or by textcat_Preload(). A
+     * fingerprint file that cannot be read then is left out of every
+     * classification. The fingerprints are not indexed, so each
+     * classification compares them one by one.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *textcat_InitLazy(const char *conffile, const char *prefix);
+
+    /**
+     * textcat_Preload() - Read the fingerprint of the category called name
+     * now, or all fingerprints when name is NULL, if handle was made by
+     * textcat_InitLazy() and they were not read yet.
+     *
+     * Returns: 1 on success, 0 when a fingerprint cannot be read or there
+     * is no category called name.
+     */
+    extern int textcat_Preload(void *handle, const char *name);
+
+    /**
+     * textcat_InitBundle() - Initialize the text classifier with the
+     * fingerprints in bundlefile, which textcat_WriteBundle() wrote. The
+     * file is mapped into memory as it is, so this takes no parsing or
+     * sorting, and handles on the same bundlefile share the fingerprints
+     * until it is replaced or written to.
+     *
+     * Returns: handle on success, NULL on error, which includes a
+     * bundlefile that is damaged, or was written by another version of the
+     * library or on another kind of machine.
+     */
+    extern void *textcat_InitBundle(const char *bundlefile);
+
+    /**
+     * textcat_WriteBundle() - Write the fingerprints of handle, sorted and
+     * indexed as they are in memory, to bundlefile. See the createbundle
+     * program.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int textcat_WriteBundle(void *handle, const char *bundlefile);
+
+    /**
+     * textcat_InitBundleFd() - Same as textcat_InitBundle(), for a bundle
+     * in the file or shared memory object fd, such as one from
+     * memfd_create() or shm_open() that textcat_WriteBundleFd() filled.
+     * The mapping is read-only and shared, so processes that map the same
+     * object share its memory. fd can be closed once this returns.
+     *
+     * flags combines TCBUNDLE_ flags. The first three are hints that the
+     * system may ignore: TCBUNDLE_WILLNEED reads the whole bundle in ahead
+     * of use, TCBUNDLE_LOCK locks it into memory and TCBUNDLE_HUGEPAGES
+     * asks for huge pages. With TCBUNDLE_TRUSTED the checksum is not
+     * checked, so that a process that maps a bundle another process has
+     * checked does not read it all. Everything else still is: a damaged
+     * bundle may give wrong results then, but not make the library read
+     * outside it. Handles on the same object share the fingerprints, with
+     * the flags of the first.
+     *
+     * Returns: handle on success, NULL on error, or where there is no
+     * mmap().
+     */
+    extern void *textcat_InitBundleFd(int fd, int flags);
+
+    /**
+     * textcat_WriteBundleFd() - Same as textcat_WriteBundle(), into the
+     * file or shared memory object fd, which is resized to fit: to a
+     * whole number of huge pages for one from memfd_create() with
+     * MFD_HUGETLB.
+     *
+     * Returns: 1 on success, 0 on error, or where there is no mmap().
+     */
+    extern int textcat_WriteBundleFd(void *handle, int fd);
+
+    /**
+     * textcat_InitBundleMemory() - Same as textcat_InitBundle(), for a
+     * bundle of size bytes at data, aligned to 8 bytes at least, which
+     * must stay as it is until the last handle on it is freed. flags are
+     * as for textcat_InitBundleFd(), of which only TCBUNDLE_TRUSTED
+     * applies. Handles on the same data share the fingerprints.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *textcat_InitBundleMemory(const void *data, size_t size,
+                                          int flags);
+
+    /**
+     * textcat_InitBuiltin() - Initialize the text classifier with the
+     * stock fingerprints of langclass/, compiled into the library when it
+     * was configured with --enable-builtin-models. This reads no files and
+     * copies nothing: the fingerprints and their index are used where
+     * they lie in the read-only data of the library.
+     *
+     * Returns: handle on success, NULL on error, or when the library was
+     * built without the stock fingerprints.
+     */
+    extern void *textcat_InitBuiltin(void);
+
+    /**
+     * textcat_NewSession() - Make another handle on the fingerprints of
+     * handle, with the same properties and executor. It costs no more
+     * than the memory it classifies with, so every thread can have its
+     * own. A handle must not be used by several threads at once, except
+     * for textcat_ClassifyFull(), textcat_ClassifyFullWithContext() and
+     * textcat_ClassifyFullWithMask().
+     * Free the new handle with textcat_Done().
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *textcat_NewSession(void *handle);
+
+    /**
+     * textcat_Reload() - Read the fingerprints of handle again from the
+     * files it was made from, and switch handle and all its sessions over
+     * to them. Any thread may reload while others classify: a
+     * classification uses the fingerprints that were current when it
+     * started, and never waits for a reload. The old fingerprints are
+     * freed once the classifications that use them are done. Which
+     * categories a handle disabled carries over by name, and the names
+     * that classifications report stay valid until the last session of
+     * handle is done. Handles made from memory or a file descriptor
+     * cannot be reloaded. The fingerprint files are read on the threads
+     * of handle (see TCPROP_THREADS) or by its executor, if it has either.
+     *
+     * Returns: 1 on success, 0 on error, in which case handle keeps its
+     * fingerprints.
+     */
+    extern int textcat_Reload(void *handle);
+
+    /**
+     * textcat_SetEnabled() - Enable or disable the categories of handle
+     * that go by name: the category called name, or every category whose
+     * name starts with the language tag name and a '-', so that "zh"
+     * covers "zh-CN-utf8" and "zh-TW-utf8". A NULL name covers all
+     * categories. Classifications do not even look at the categories that
+     * are disabled, and with textcat_InitLazy() never read them. Sessions
+     * made afterwards take over what is disabled. Must not be called
+     * while handle classifies.
+     *
+     * Returns: the number of categories that name covers, or -1 on error.
+     */
+    extern int textcat_SetEnabled(void *handle, const char *name,
+                                  int enabled);
+
+    /**
+     * textcat_GetMask() - Make a language mask for handle and its sessions
+     * from names, a list of category names or language tags as for
+     * textcat_SetEnabled() that ends with NULL. A classification with the
+     * mask only considers the categories that names covers and that are
+     * not disabled, so that one handle can serve callers that each want
+     * their own languages. Categories that only come with a later
+     * textcat_Reload() are not covered. Free the mask with
+     * textcat_ReleaseMask().
+     *
+     * Returns: mask on success, NULL on error.
+     */
+    extern void *textcat_GetMask(void *handle, const char *const *names);
+
+    /**
+     * textcat_ReleaseMask() - Free up resources for mask
+     */
+    extern void textcat_ReleaseMask(void *handle, void *mask);
+
     extern int textcat_SetProperty(void *handle, textcat_Property property,
                                    sint4 value);
 
+    /**
+     * textcat_SetExecutor() - Have executor run the parts of the work when
+     * TCPROP_THREADS is more than 1, rather than threads of the library's
+     * own. A NULL executor goes back to the threads of the library.
+     */
+    extern void textcat_SetExecutor(void *handle, textcat_Executor executor,
+                                    void *data);
+
     /**
      * textcat_Done() - Free up resources for handle
      */
@@ -106,7 +329,8 @@ extern "C"
      *
      * Returns: string containing a list of category id's, each one
      * between square brackets, "UNKNOWN" when not recognized, "SHORT" if the
-     * document was too short to make a reliable assessment.
+     * document was too short to make a reliable assessment. The string
+     * belongs to handle, and is overwritten by the next call.
      *
      * Performace note: longer buffers take longer to process. However,
      * for many uses it is not necessary to categorize the whole buffer.
@@ -130,7 +354,11 @@ extern "C"
 
     /**
      * textcat_ClassifyFull() - Give the most likely categories for buffer
-     * with length size.
+     * with length size. The memory a classification works with is kept
+     * with handle for the next call, except where several threads
+     * classify with handle at once: the others allocate theirs. Callers
+     * that want to hold that memory themselves, one context per thread,
+     * use textcat_ClassifyFullWithContext() instead.
      *
      * Returns: the numbers of results.
      *
@@ -141,6 +369,105 @@ extern "C"
     extern int textcat_ClassifyFull(void *handle, const char *buffer,
                                     size_t size, candidate_t * candidates);
 
+    /**
+     * textcat_GetContext() - Create a context for classifying with handle.
+     * A context holds the working memory of a classification, and reuses
+     * it from one call to the next, so that a steady stream of
+     * classifications does not allocate any memory. A context must not be
+     * used by more than one thread at a time; give each thread its own.
+     *
+     * Returns: context on success, NULL on error.
+     */
+    extern void *textcat_GetContext(void *handle);
+
+    /**
+     * textcat_ReleaseContext() - Free up resources for context
+     */
+    extern void textcat_ReleaseContext(void *handle, void *context);
+
+    /**
+     * textcat_ClassifyFullWithContext() - Same as textcat_ClassifyFull(),
+     * using the memory of context, which was created for handle by
+     * textcat_GetContext().
+     *
+     * Returns: the numbers of results.
+     */
+    extern int textcat_ClassifyFullWithContext(void *handle, void *context,
+                                               const char *buffer,
+                                               size_t size,
+                                               candidate_t * candidates);
+
+    /**
+     * textcat_ClassifyFullWithMask() - Same as
+     * textcat_ClassifyFullWithContext(), but only with the categories
+     * that mask allows, see textcat_GetMask(). A NULL mask allows all.
+     *
+     * Returns: the numbers of results, or TEXTCAT_RESULT_UNKNOWN when mask
+     * was not made for handle or one of its sessions.
+     */
+    extern int textcat_ClassifyFullWithMask(void *handle, void *context,
+                                            const void *mask,
+                                            const char *buffer, size_t size,
+                                            candidate_t * candidates);
+
+    /**
+     * textcat_ClassifyBatch() - Classify count documents in one call. The
+     * outcome for document i goes to results[i], which is what
+     * textcat_ClassifyFull() would return for its size bytes followed by a
+     * zero byte, and its candidates go to candidates[i * TEXTCAT_MAXCANDIDATES]
+     * onwards. Documents are read where they are, without copying, and
+     * nothing past their size bytes is read. The memory the work needs is
+     * allocated once for the whole batch. With TCPROP_THREADS set to n > 1
+     * the documents are spread over n threads (or parts for the executor,
+     * see textcat_SetExecutor()). The threads of the library work on one
+     * call at a time: while another call has them, the batch runs on the
+     * calling thread alone, with the same outcome. Nothing tells the caller
+     * which happened, so a caller that needs the batch spread out should
+     * give it an executor.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int textcat_ClassifyBatch(void *handle,
+                                     const textcat_span_t * spans,
+                                     uint4 count, candidate_t * candidates,
+                                     int *results);
+
+    /**
+     * textcat_ClassifyPacked() - Same as textcat_ClassifyBatch() for
+     * documents packed into one buffer: document i is the bytes from
+     * buffer + offsets[i] up to buffer + offsets[i + 1], so offsets has
+     * count + 1 entries.
+     *
+     * Returns: 1 on success, 0 on error.
+     */
+    extern int textcat_ClassifyPacked(void *handle, const char *buffer,
+                                      const size_t *offsets, uint4 count,
+                                      candidate_t * candidates,
+                                      int *results);
+
+    /**
+     * textcat_GetScoredCount() - The number of categories the last
+     * classification with context compared the buffer with, out of those
+     * that are enabled and that its mask allows. Categories that the
+     * n-gram index scores all at once count as well; without the index,
+     * it shows how many were passed over, with the exact search or the
+     * beam search set by TCPROP_BEAM_WIDTH.
+     */
+    extern uint4 textcat_GetScoredCount(void *handle, void *context);
+
+    /**
+     * textcat_ClassifyScript() - Give the script most letters of the
+     * utf-8 buffer with length size are written in, without looking at
+     * any of the categories of handle. Much cheaper than classifying the
+     * language, for callers that only need to know the script.
+     *
+     * Returns: the ISO 15924 code of the script, e.g. "Latn" or "Cyrl",
+     * "Zzzz" for a script that is not told apart from others, or
+     * TEXTCAT_RESULT_SHORT_STR if buffer has no letters at all.
+     */
+    extern const char *textcat_ClassifyScript(void *handle,
+                                              const char *buffer,
+                                              size_t size);
 
     /**
      * textcat_Version() - Returns a string describing the version of this
@@ -5,6 +5,9 @@ enum textcat_Property_s
 {
     TCPROP_UTF8AWARE = 0,
     TCPROP_MINIMUM_DOCUMENT_SIZE = 1,
+    TCPROP_ADAPTIVE_ORDER = 2,
+    TCPROP_BEAM_WIDTH = 3,
+    TCPROP_THREADS = 4,
     TCPROP_LAST
 };
 
@@ -0,0 +1,233 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+/**
+ * wg_threadpool.c -- a fixed set of threads that run the parts of a task.
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * DESCRIPTION
+ *
+ * The threads of a pool sleep until wgthreadpool_Run() hands them a
+ * task. Every thread, the caller included, then takes the next part that
+ * nobody has taken yet, until all parts are taken, so that parts of
+ * unequal cost balance out. The last thread to finish a part wakes the
+ * caller.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "common_impl.h"
+#include "wg_threadpool.h"
+
+#ifdef HAVE_PTHREAD_H
+
+typedef struct
+{
+    pthread_t *thread;
+    uint4 nthreads;
+
+    pthread_mutex_t busy;       /* held by the running task */
+    pthread_mutex_t lock;       /* protects everything below */
+    pthread_cond_t wake;        /* a task came in, or the pool stops */
+    pthread_cond_t finished;    /* the last part of the task is done */
+
+    wgthreadpool_task_t task;
+    void *arg;
+    uint4 nparts;
+    uint4 next;                 /* next part to run */
+    uint4 pending;              /* parts not finished yet */
+    uint4 generation;           /* number of tasks so far */
+    boole stop;
+} pool_t;
+
+/* runs parts of the current task until there are none left */
+static void runparts(pool_t * p)
+{
+    while (p->next < p->nparts)
+    {
+        uint4 part = p->next++;
+
+        pthread_mutex_unlock(&p->lock);
+        p->task(p->arg, part);
+        pthread_mutex_lock(&p->lock);
+
+        if (--p->pending == 0)
+        {
+            pthread_cond_broadcast(&p->finished);
+        }
+    }
+}
+
+static void *worker(void *arg)
+{
+    pool_t *p = (pool_t *) arg;
+    uint4 seen = 0;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;)
+    {
+        while (!p->stop && p->generation == seen)
+        {
+            pthread_cond_wait(&p->wake, &p->lock);
+        }
+        if (p->stop)
+        {
+            break;
+        }
+        seen = p->generation;
+        runparts(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+extern void *wgthreadpool_Init(uint4 nthreads)
+{
+    pool_t *p = (pool_t *) calloc(1, sizeof(pool_t));
+
+    if (!p)
+    {
+        return NULL;
+    }
+    p->thread = (pthread_t *) malloc(sizeof(pthread_t) * (nthreads + 1));
+    if (!p->thread)
+    {
+        free(p);
+        return NULL;
+    }
+    pthread_mutex_init(&p->busy, NULL);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->finished, NULL);
+
+    for (p->nthreads = 0; p->nthreads < nthreads; p->nthreads++)
+    {
+        if (pthread_create(&p->thread[p->nthreads], NULL, worker, p) != 0)
+        {
+            /*** Make do with the threads we have ***/
+            break;
+        }
+    }
+    return p;
+}
+
+extern void wgthreadpool_Done(void *handle)
+{
+    pool_t *p = (pool_t *) handle;
+    uint4 i;
+
+    if (!p)
+    {
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (i = 0; i < p->nthreads; i++)
+    {
+        pthread_join(p->thread[i], NULL);
+    }
+
+    pthread_cond_destroy(&p->finished);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->busy);
+    free(p->thread);
+    free(p);
+}
+
+extern void wgthreadpool_Run(void *handle, wgthreadpool_task_t task,
+                             void *arg, uint4 nparts)
+{
+    pool_t *p = (pool_t *) handle;
+    uint4 i;
+
+    if (!p || p->nthreads == 0 || pthread_mutex_trylock(&p->busy) != 0)
+    {
+        for (i = 0; i < nparts; i++)
+        {
+            task(arg, i);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&p->lock);
+    p->task = task;
+    p->arg = arg;
+    p->nparts = nparts;
+    p->next = 0;
+    p->pending = nparts;
+    p->generation++;
+    pthread_cond_broadcast(&p->wake);
+
+    runparts(p);
+    while (p->pending > 0)
+    {
+        pthread_cond_wait(&p->finished, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_unlock(&p->busy);
+}
+
+#else
+
+/*** Without threads, the caller does all the work ***/
+
+extern void *wgthreadpool_Init(uint4 nthreads)
+{
+    return malloc(1);
+}
+
+extern void wgthreadpool_Done(void *handle)
+{
+    free(handle);
+}
+
+extern void wgthreadpool_Run(void *handle, wgthreadpool_task_t task,
+                             void *arg, uint4 nparts)
+{
+    uint4 i;
+
+    for (i = 0; i < nparts; i++)
+    {
+        task(arg, i);
+    }
+}
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,76 @@
+/* -*- Mode: C++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+#ifndef _WG_THREADPOOL_H_
+#define _WG_THREADPOOL_H_
+/**
+ * wg_threadpool.h -- a fixed set of threads that run the parts of a task
+ *
+ * THE BSD LICENSE
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *
+ * - Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the
+ * distribution.
+ *
+ * - Neither the name of the WiseGuys Internet B.V. nor the names of
+ * its contributors may be used to endorse or promote products derived
+ * from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "common.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    typedef void (*wgthreadpool_task_t) (void *arg, uint4 part);
+
+    /**
+     * wgthreadpool_Init() - Start nthreads threads. Without thread support
+     * the pool has none, and wgthreadpool_Run() does all the work itself.
+     *
+     * Returns: handle on success, NULL on error.
+     */
+    extern void *wgthreadpool_Init(uint4 nthreads);
+
+    /**
+     * wgthreadpool_Done() - Stop the threads and free up resources for
+     * handle
+     */
+    extern void wgthreadpool_Done(void *handle);
+
+    /**
+     * wgthreadpool_Run() - Run task(arg, part) for every part from 0 to
+     * nparts - 1 on the threads of handle and the calling thread, and
+     * return when all are done. Runs from several threads at once do not
+     * wait for each other: while the pool is busy, the caller runs all
+     * parts by itself.
+     */
+    extern void wgthreadpool_Run(void *handle, wgthreadpool_task_t task,
+                                 void *arg, uint4 nparts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */